@@ -0,0 +1,32 @@
+#pragma once
+#include <atomic>
+
+/// Test fixture: base of a payload which counts its living instances, so tests can check nothing leaked or was
+/// destroyed early. Tag (usually the payload itself) keeps the count of every payload type apart.
+///
+///	struct payload : alive_counter<payload> { ... };
+///	REQUIRE(payload::alive_ == 0);
+///
+template<typename Tag>
+struct alive_counter
+{
+	/// Atomic: payloads are created and destroyed by many threads.
+	static inline std::atomic<int> alive_{0};
+
+	alive_counter() noexcept
+	{
+		++alive_;
+	}
+
+	alive_counter(const alive_counter&) noexcept
+	{
+		++alive_;
+	}
+
+	alive_counter& operator=(const alive_counter&) noexcept = default;
+
+	~alive_counter()
+	{
+		--alive_;
+	}
+};
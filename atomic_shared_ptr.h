@@ -0,0 +1,237 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <thread>
+#include <utility>
+
+#include "shared_ptr.h"
+
+/// Lock free atomic shared pointer (similar to std::atomic<std::shared_ptr<T>>) using split reference counting.
+///
+/// Slot is one 64 bit word: control block pointer in low 48 bits and count of references handed out to readers in high 16 bits.
+///	- While a control block is stored in the slot, the slot pays `prepaid` strong references to usages_ in advance.
+///	- load() takes one of them by a CAS on the slot word, only while fewer than prepaid are taken. usages_ is not touched.
+///	- Writer which removes the block gives back the prepaid references the readers did not take.
+///	- Every reader which takes a reference at or above refill_at pays a new batch to usages_ and lowers the count
+///	  in the slot. First one wins, the others take their batch back. So a stalled reader does not stop the refill.
+///	- All prepaid references taken and none refilled yet: readers yield until one of the refilling readers is done.
+///	  Every reference handed out is paid.
+///	- Batch is small, so many slots can hold one object: usages_ must stay below max_usages of atomic_counting
+///	  (2^29 - 1), that is below 131072 slots less the batches being refilled. Paying past it aborts, in every build.
+///
+/// Notes:
+///	- use_count() of an object stored in the slot includes the prepaid references.
+///	- Only single word CAS is needed. Lock free on every platform with lock free std::atomic<std::uint64_t> (x86-64 included).
+///	- Pointers must fit into 48 bits (user space on x86-64 and AArch64).
+///	- Stored shared_ptr must point to the payload of its block. Aliased or converted to another address aborts, in every build.
+///	- borrow() reads the slot without any reference at all. Only for objects created by make_epoch_shared (epoch.h).
+///
+namespace smart_ptr
+{
+
+class epoch_guard;
+
+template<typename T>
+class atomic_shared_ptr
+{
+	using control_block = typename shared_ptr<T>::control_block;
+
+	static constexpr int pointer_bits = 48;
+	static constexpr std::uint64_t pointer_mask = (std::uint64_t{1} << pointer_bits) - 1;
+	static constexpr std::uint64_t one_reader = std::uint64_t{1} << pointer_bits;
+	static constexpr int prepaid = 1 << 12;
+	static constexpr int refill_at = prepaid / 2;
+	static_assert(prepaid < (1 << (64 - pointer_bits)));
+
+	mutable std::atomic<std::uint64_t> word_{0};
+
+	static control_block* control_of_(const std::uint64_t word) noexcept
+	{
+		return reinterpret_cast<control_block*>(static_cast<std::uintptr_t>(word & pointer_mask));
+	}
+
+	static int readers_of_(const std::uint64_t word) noexcept
+	{
+		return static_cast<int>(word >> pointer_bits);
+	}
+
+	/// Adds count strong references at once. Hard check: a count carried into the flags would read as zero.
+	static void pay_(control_block* control, const int count) noexcept
+	{
+		if (control->usages_.fetch_add(count) > atomic_counting::max_usages - count)
+		{
+			detail::fatal("smart_ptr: strong count of an object stored in atomic_shared_ptr slots overflows\n");
+		}
+	}
+
+	/// Takes over the reference of desired and pays prepaid references for readers.
+	static std::uint64_t install_(shared_ptr<T>& desired) noexcept
+	{
+		// Slot keeps the control block only, get() of a load is its payload.
+		desired.require_not_aliased_();
+		control_block* control = std::exchange(desired.control_, nullptr);
+		if (control)
+		{
+			pay_(control, prepaid);
+		}
+		const auto word = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(control));
+		assert((word & ~pointer_mask) == 0);
+		return word;
+	}
+
+	/// Gives back prepaid references nobody took. Returns the reference which the slot owned.
+	static shared_ptr<T> uninstall_(const std::uint64_t word) noexcept
+	{
+		control_block* control = control_of_(word);
+		if (control)
+		{
+			// Never drops to zero. Slot still owns its own reference.
+			control->usages_ -= prepaid - readers_of_(word);
+		}
+		return shared_ptr<T>{control};
+	}
+
+	/// Caller holds a reference taken from the slot, so control block is alive.
+	void refill_(control_block* control) const noexcept
+	{
+		pay_(control, refill_at);
+		std::uint64_t expected = word_.load(std::memory_order_relaxed);
+		// Count below refill_at means the block was removed and stored again. Our batch does not belong to that count.
+		while (control_of_(expected) == control && readers_of_(expected) >= refill_at)
+		{
+			if (word_.compare_exchange_weak(expected, expected - refill_at * one_reader))
+			{
+				return;
+			}
+		}
+		// Writer removed the block meanwhile and has already settled all references handed out.
+		control->usages_ -= refill_at;
+	}
+
+public:
+	static constexpr bool is_always_lock_free = std::atomic<std::uint64_t>::is_always_lock_free;
+
+	constexpr atomic_shared_ptr() noexcept = default;
+
+	explicit atomic_shared_ptr(shared_ptr<T> desired) noexcept
+		: word_(install_(desired))
+	{
+	}
+
+	atomic_shared_ptr(const atomic_shared_ptr&) = delete;
+	atomic_shared_ptr& operator=(const atomic_shared_ptr&) = delete;
+
+	~atomic_shared_ptr()
+	{
+		uninstall_(word_.load(std::memory_order_relaxed));
+	}
+
+	void operator=(shared_ptr<T> desired) noexcept
+	{
+		store(std::move(desired));
+	}
+
+	[[nodiscard]] bool is_lock_free() const noexcept
+	{
+		return word_.is_lock_free();
+	}
+
+	[[nodiscard]] shared_ptr<T> load(const std::memory_order order = std::memory_order_seq_cst) const noexcept
+	{
+		const std::memory_order load_order = order == std::memory_order_acq_rel ? std::memory_order_acquire : order == std::memory_order_release ? std::memory_order_relaxed : order;
+		std::uint64_t word = word_.load(load_order);
+		for (;;)
+		{
+			control_block* control = control_of_(word);
+			if (!control)
+			{
+				return shared_ptr<T>{};
+			}
+			const int readers = readers_of_(word);
+			if (readers >= prepaid)
+			{
+				// Taking one more would hand out an unpaid reference. Readers holding one refill.
+				std::this_thread::yield();
+				word = word_.load(load_order);
+				continue;
+			}
+			if (word_.compare_exchange_weak(word, word + one_reader, order, load_order))
+			{
+				if (readers + 1 >= refill_at)
+				{
+					refill_(control);
+				}
+				return shared_ptr<T>{control};
+			}
+		}
+	}
+
+	operator shared_ptr<T>() const noexcept
+	{
+		return load();
+	}
+
+	/// Raw pointer valid until the guard ends. Plain load, no reference taken.
+	/// Object must come from make_epoch_shared, so its destruction waits for the guard.
+	[[nodiscard]] T* borrow(const epoch_guard&) const noexcept
+	{
+		control_block* control = control_of_(word_.load(std::memory_order_acquire));
+		assert(!control || detail::epoch_payload<T>::is_epoch_reclaimed(control));
+		return control ? static_cast<T*>(control->payload_) : nullptr;
+	}
+
+	void store(shared_ptr<T> desired, const std::memory_order order = std::memory_order_seq_cst) noexcept
+	{
+		uninstall_(word_.exchange(install_(desired), order));
+	}
+
+	shared_ptr<T> exchange(shared_ptr<T> desired, const std::memory_order order = std::memory_order_seq_cst) noexcept
+	{
+		return uninstall_(word_.exchange(install_(desired), order));
+	}
+
+	/// Compares only control blocks. Count of readers in the slot may change meanwhile, that is not a failure.
+	bool compare_exchange_strong(shared_ptr<T>& expected, shared_ptr<T> desired, const std::memory_order success, const std::memory_order failure) noexcept
+	{
+		const std::uint64_t desired_word = install_(desired);
+		std::uint64_t current = word_.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			if (control_of_(current) == expected.control_)
+			{
+				if (word_.compare_exchange_weak(current, desired_word, success, std::memory_order_relaxed))
+				{
+					uninstall_(current);
+					return true;
+				}
+				continue;
+			}
+			shared_ptr<T> actual = load(failure);
+			if (actual.control_ != expected.control_)
+			{
+				expected = std::move(actual);
+				uninstall_(desired_word);
+				return false;
+			}
+			current = word_.load(std::memory_order_relaxed);
+		}
+	}
+
+	bool compare_exchange_strong(shared_ptr<T>& expected, shared_ptr<T> desired, const std::memory_order order = std::memory_order_seq_cst) noexcept
+	{
+		return compare_exchange_strong(expected, std::move(desired), order, order == std::memory_order_acq_rel ? std::memory_order_acquire : order == std::memory_order_release ? std::memory_order_relaxed : order);
+	}
+
+	bool compare_exchange_weak(shared_ptr<T>& expected, shared_ptr<T> desired, const std::memory_order success, const std::memory_order failure) noexcept
+	{
+		return compare_exchange_strong(expected, std::move(desired), success, failure);
+	}
+
+	bool compare_exchange_weak(shared_ptr<T>& expected, shared_ptr<T> desired, const std::memory_order order = std::memory_order_seq_cst) noexcept
+	{
+		return compare_exchange_strong(expected, std::move(desired), order);
+	}
+};
+
+}
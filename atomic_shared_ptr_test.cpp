@@ -0,0 +1,198 @@
+#include "catch.hpp"
+#include "alive_counter.h"
+#include "atomic_shared_ptr.h"
+
+#include <thread>
+#include <vector>
+
+namespace
+{
+struct counted : alive_counter<counted>
+{
+	int value_;
+
+	explicit counted(const int value)
+		: value_(value)
+	{
+	}
+
+	counted(const counted&) = delete;
+	counted& operator=(const counted&) = delete;
+};
+
+struct counted_leaf : counted
+{
+	using counted::counted;
+};
+}
+
+TEST_CASE("atomic_shared_ptr basic operations")
+{
+	smart_ptr::atomic_shared_ptr<counted> slot;
+	REQUIRE(slot.is_lock_free());
+	REQUIRE(!slot.load());
+
+	SECTION("store and load")
+	{
+		slot.store(smart_ptr::make_shared<counted>(1));
+		const auto loaded = slot.load();
+		REQUIRE(loaded->value_ == 1);
+		slot.store(smart_ptr::make_shared<counted>(2));
+		REQUIRE(loaded->value_ == 1);
+		REQUIRE(loaded.use_count() == 1);
+		REQUIRE(slot.load()->value_ == 2);
+	}
+
+	SECTION("exchange returns the only owner")
+	{
+		slot = smart_ptr::make_shared<counted>(3);
+		const auto old = slot.exchange(smart_ptr::shared_ptr<counted>{});
+		REQUIRE(old->value_ == 3);
+		REQUIRE(old.use_count() == 1);
+		REQUIRE(!slot.load());
+	}
+
+	SECTION("compare_exchange")
+	{
+		auto first = smart_ptr::make_shared<counted>(4);
+		slot.store(first);
+		smart_ptr::shared_ptr<counted> expected;
+		REQUIRE(!slot.compare_exchange_strong(expected, smart_ptr::make_shared<counted>(5)));
+		REQUIRE(expected == first);
+		REQUIRE(slot.compare_exchange_strong(expected, smart_ptr::make_shared<counted>(6)));
+		REQUIRE(slot.load()->value_ == 6);
+		REQUIRE(first.use_count() == 2); // first and expected
+	}
+
+	SECTION("Converted pointer to a base at the same address")
+	{
+		slot.store(smart_ptr::make_shared<counted_leaf>(7));
+		REQUIRE(slot.load()->value_ == 7);
+	}
+	slot.store(smart_ptr::shared_ptr<counted>{});
+	REQUIRE(counted::alive_ == 0);
+}
+
+TEST_CASE("atomic_shared_ptr gives back prepaid references")
+{
+	auto payload = smart_ptr::make_shared<counted>(7);
+	const smart_ptr::weak_ptr<counted> weak(payload);
+	{
+		smart_ptr::atomic_shared_ptr<counted> slot(payload);
+		// More loads than one prepaid batch. Readers refill the batch.
+		std::vector<smart_ptr::shared_ptr<counted>> readers;
+		for (int i = 0; i < 100'000; ++i)
+		{
+			readers.push_back(slot.load());
+		}
+		REQUIRE(readers.back()->value_ == 7);
+		readers.clear();
+	}
+	REQUIRE(payload.use_count() == 1);
+	payload = smart_ptr::shared_ptr<counted>{};
+	REQUIRE(weak.expired());
+	REQUIRE(counted::alive_ == 0);
+}
+
+TEST_CASE("atomic_shared_ptr slots share one object")
+{
+	auto payload = smart_ptr::make_shared<counted>(3);
+	{
+		// Prepaid batches of all slots together stay below the flags of the strong count.
+		std::vector<smart_ptr::atomic_shared_ptr<counted>> slots(10'000);
+		for (auto& slot : slots)
+		{
+			slot.store(payload);
+		}
+		REQUIRE(slots.back().load()->value_ == 3);
+		REQUIRE(payload.use_count() > 10'000);
+	}
+	REQUIRE(payload.use_count() == 1);
+}
+
+TEST_CASE("atomic_shared_ptr readers only")
+{
+	constexpr int readers = 4;
+	constexpr int loads = 2'000'000;
+	auto payload = smart_ptr::make_shared<counted>(5);
+	{
+		// Many times prepaid loads and no writer: readers alone keep paying the batches.
+		const smart_ptr::atomic_shared_ptr<counted> slot(payload);
+		std::atomic<bool> wrong_value{false};
+		std::vector<std::thread> threads;
+		for (int r = 0; r < readers; ++r)
+		{
+			threads.emplace_back([&slot, &wrong_value]
+			{
+				std::vector<smart_ptr::shared_ptr<counted>> held(64);
+				for (int i = 0; i < loads; ++i)
+				{
+					auto& kept = held[static_cast<std::size_t>(i) % held.size()];
+					kept = slot.load();
+					if (kept->value_ != 5)
+					{
+						wrong_value = true;
+					}
+				}
+			});
+		}
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+		REQUIRE(!wrong_value);
+		REQUIRE(counted::alive_ == 1);
+		REQUIRE(slot.load()->value_ == 5);
+	}
+	REQUIRE(payload.use_count() == 1);
+	payload.reset();
+	REQUIRE(counted::alive_ == 0);
+}
+
+TEST_CASE("atomic_shared_ptr readers racing writer")
+{
+	constexpr int readers = 3;
+	constexpr int iterations = 20'000;
+	{
+		smart_ptr::atomic_shared_ptr<counted> slot(smart_ptr::make_shared<counted>(0));
+		std::vector<std::thread> threads;
+		std::atomic<bool> wrong_value{false};
+		for (int r = 0; r < readers; ++r)
+		{
+			threads.emplace_back([&slot, &wrong_value]
+			{
+				int last = 0;
+				for (int i = 0; i < iterations; ++i)
+				{
+					const auto loaded = slot.load();
+					if (loaded->value_ < last)
+					{
+						wrong_value = true;
+					}
+					last = loaded->value_;
+				}
+			});
+		}
+		for (int i = 1; i <= iterations; ++i)
+		{
+			if (i % 2)
+			{
+				slot.store(smart_ptr::make_shared<counted>(i));
+			}
+			else
+			{
+				auto expected = slot.load();
+				while (!slot.compare_exchange_weak(expected, smart_ptr::make_shared<counted>(i)))
+				{
+				}
+			}
+		}
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+		REQUIRE(!wrong_value);
+		REQUIRE(slot.load()->value_ == iterations);
+	}
+	REQUIRE(counted::alive_ == 0);
+}
@@ -0,0 +1,137 @@
+#include "bench.h"
+#include "atomic_shared_ptr.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+
+/// Loads per second from one published snapshot: smart_ptr::atomic_shared_ptr against
+/// std::atomic<std::shared_ptr> (lock based in libstdc++) and std::shared_ptr guarded by std::mutex.
+///
+/// Usage: atomic_shared_ptr_bench [max_threads]
+///	- read only: every thread loads and reads the snapshot.
+///	- 1 writer: thread 0 publishes a new snapshot after every load, the others load.
+
+namespace
+{
+
+struct config
+{
+	long version_;
+	long routes_[7]{};
+};
+
+constexpr int loads_per_thread = 1'000'000;
+
+struct smart_slot
+{
+	smart_ptr::atomic_shared_ptr<config> slot_{smart_ptr::make_shared<config>(0)};
+
+	long read()
+	{
+		return slot_.load()->version_;
+	}
+
+	void write(const long version)
+	{
+		slot_.store(smart_ptr::make_shared<config>(version));
+	}
+};
+
+#if defined(__cpp_lib_atomic_shared_ptr)
+struct std_atomic_slot
+{
+	std::atomic<std::shared_ptr<config>> slot_{std::make_shared<config>(0)};
+
+	long read()
+	{
+		return slot_.load()->version_;
+	}
+
+	void write(const long version)
+	{
+		slot_.store(std::make_shared<config>(version));
+	}
+};
+#endif
+
+struct mutex_slot
+{
+	std::mutex mutex_;
+	std::shared_ptr<config> slot_{std::make_shared<config>(0)};
+
+	long read()
+	{
+		std::shared_ptr<config> copy;
+		{
+			std::lock_guard lock(mutex_);
+			copy = slot_;
+		}
+		return copy->version_;
+	}
+
+	void write(const long version)
+	{
+		auto fresh = std::make_shared<config>(version);
+		std::lock_guard lock(mutex_);
+		slot_.swap(fresh);
+	}
+};
+
+template<typename Slot>
+double loads_per_second(const int threads, const bool with_writer)
+{
+	Slot slot;
+	const double seconds = bench::run_threads(threads, [&slot, with_writer](const int index)
+	{
+		long sum = 0;
+		for (int i = 0; i < loads_per_thread; ++i)
+		{
+			sum += slot.read();
+			if (with_writer && index == 0)
+			{
+				slot.write(i);
+			}
+		}
+		bench::do_not_optimize(sum);
+	});
+	return static_cast<double>(threads) * loads_per_thread / seconds;
+}
+
+template<typename Slot>
+void row(const char* name, const std::vector<int>& counts, const bool with_writer)
+{
+	std::printf("%-32s", name);
+	for (const int n : counts)
+	{
+		std::printf(" %8.2f", loads_per_second<Slot>(n, with_writer) / 1e6);
+	}
+	std::printf("\n");
+}
+
+}
+
+int main(const int argc, char* argv[])
+{
+	const int max_threads = argc > 1 ? std::atoi(argv[1]) : static_cast<int>(std::thread::hardware_concurrency());
+	const auto counts = bench::thread_counts(max_threads);
+
+	std::printf("smart_ptr::atomic_shared_ptr is lock free: %d\n", smart_ptr::atomic_shared_ptr<config>::is_always_lock_free);
+	for (const bool with_writer : {false, true})
+	{
+		std::printf("\n# loads per second (millions), %s\n%-32s", with_writer ? "1 writer" : "read only", "slot \\ threads");
+		for (const int n : counts)
+		{
+			std::printf(" %8d", n);
+		}
+		std::printf("\n");
+		row<smart_slot>("smart_ptr::atomic_shared_ptr", counts, with_writer);
+#if defined(__cpp_lib_atomic_shared_ptr)
+		row<std_atomic_slot>("std::atomic<std::shared_ptr>", counts, with_writer);
+#endif
+		row<mutex_slot>("std::mutex + std::shared_ptr", counts, with_writer);
+	}
+	return 0;
+}
@@ -0,0 +1,309 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <vector>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/// Small helpers shared by benchmarks. No dependency besides the standard library.
+namespace bench
+{
+
+using clock = std::chrono::steady_clock;
+
+/// Keeps the compiler from removing a computation whose result is not used.
+template<typename T>
+void do_not_optimize(const T& value)
+{
+#if defined(__GNUC__)
+	asm volatile("" : : "r,m"(value) : "memory");
+#else
+	static volatile const void* sink;
+	sink = &value;
+#endif
+}
+
+/// Resident set size of this process in bytes. Zero where not available.
+inline std::size_t resident_set_bytes()
+{
+#if defined(__linux__)
+	std::ifstream statm("/proc/self/statm");
+	std::size_t total_pages = 0;
+	std::size_t resident_pages = 0;
+	statm >> total_pages >> resident_pages;
+	return resident_pages * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+#else
+	return 0;
+#endif
+}
+
+/// Hardware counters of the calling thread by perf_event_open: cycles, instructions and cache misses.
+/// Not available outside Linux or where perf events are not permitted (perf_event_paranoid, containers).
+class hardware_counters
+{
+public:
+	struct values
+	{
+		std::uint64_t cycles_{0};
+		std::uint64_t instructions_{0};
+		std::uint64_t cache_misses_{0};
+	};
+
+private:
+	static constexpr int count = 3;
+	int fds_[count]{-1, -1, -1};
+
+#if defined(__linux__)
+	static int open(const std::uint64_t config, const int group) noexcept
+	{
+		perf_event_attr attr{};
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = config;
+		attr.disabled = group == -1 ? 1 : 0;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		return static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+	}
+
+	[[nodiscard]] std::uint64_t read_one(const int index) const noexcept
+	{
+		std::uint64_t value = 0;
+		return ::read(fds_[index], &value, sizeof(value)) == sizeof(value) ? value : 0;
+	}
+#endif
+
+public:
+	hardware_counters() noexcept
+	{
+#if defined(__linux__)
+		const std::uint64_t configs[count] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES};
+		for (int i = 0; i < count; ++i)
+		{
+			fds_[i] = open(configs[i], fds_[0]);
+			if (fds_[i] == -1)
+			{
+				close_all();
+				return;
+			}
+		}
+#endif
+	}
+
+	hardware_counters(const hardware_counters&) = delete;
+	hardware_counters& operator=(const hardware_counters&) = delete;
+
+	~hardware_counters()
+	{
+		close_all();
+	}
+
+	[[nodiscard]] bool available() const noexcept
+	{
+		return fds_[0] != -1;
+	}
+
+	void start() noexcept
+	{
+#if defined(__linux__)
+		if (available())
+		{
+			::ioctl(fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			::ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		}
+#endif
+	}
+
+	/// Counts since start(). Zeros when not available.
+	values stop() noexcept
+	{
+		values result;
+#if defined(__linux__)
+		if (available())
+		{
+			::ioctl(fds_[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+			result = {read_one(0), read_one(1), read_one(2)};
+		}
+#endif
+		return result;
+	}
+
+private:
+	void close_all() noexcept
+	{
+		for (int& fd : fds_)
+		{
+#if defined(__linux__)
+			if (fd != -1)
+			{
+				::close(fd);
+			}
+#endif
+			fd = -1;
+		}
+	}
+};
+
+/// Pins the calling thread to the index-th CPU this process may run on (modulo their count), so runs place
+/// threads the same way on the same machine. Returns false where pinning is not available.
+inline bool pin_current_thread(const int index)
+{
+#if defined(__linux__)
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if (::sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0)
+	{
+		return false;
+	}
+	int wanted = index % CPU_COUNT(&allowed);
+	for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+	{
+		if (CPU_ISSET(cpu, &allowed) && wanted-- == 0)
+		{
+			cpu_set_t one;
+			CPU_ZERO(&one);
+			CPU_SET(cpu, &one);
+			return ::pthread_setaffinity_np(::pthread_self(), sizeof(one), &one) == 0;
+		}
+	}
+	return false;
+#else
+	static_cast<void>(index);
+	return false;
+#endif
+}
+
+/// Runs body(thread_index) on thread_count threads. All threads start together.
+/// Returns wall time from the first thread starting its body to the last thread finishing it.
+/// (Measured by the workers themselves. The main thread may not even be scheduled meanwhile.)
+/// With pin, thread i is pinned by pin_current_thread(i) before the start.
+inline double run_threads(const int thread_count, const std::function<void(int)>& body, const bool pin = false)
+{
+	std::barrier start(thread_count);
+	std::vector<clock::time_point> begins(thread_count);
+	std::vector<clock::time_point> ends(thread_count);
+	std::vector<std::thread> threads;
+	threads.reserve(thread_count);
+	for (int i = 0; i < thread_count; ++i)
+	{
+		threads.emplace_back([&, i]
+		{
+			if (pin)
+			{
+				pin_current_thread(i);
+			}
+			start.arrive_and_wait();
+			begins[i] = clock::now();
+			body(i);
+			ends[i] = clock::now();
+		});
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	const auto begin = *std::min_element(begins.begin(), begins.end());
+	const auto end = *std::max_element(ends.begin(), ends.end());
+	return std::chrono::duration<double>(end - begin).count();
+}
+
+/// Atomic operations done by this thread through counted_atomic.
+struct atomic_ops
+{
+	long loads_{0};
+	long stores_{0};
+	long rmws_{0};
+};
+
+inline thread_local atomic_ops counted_ops;
+
+/// std::atomic which counts its operations in counted_ops. Plug into basic_*_counting to get atomic operations per shared_ptr operation.
+template<typename T>
+struct counted_atomic
+{
+	std::atomic<T> value_;
+
+	constexpr counted_atomic(const T value) noexcept
+		: value_(value)
+	{
+	}
+
+	T load(const std::memory_order order = std::memory_order_seq_cst) const noexcept
+	{
+		++counted_ops.loads_;
+		return value_.load(order);
+	}
+
+	void store(const T value, const std::memory_order order = std::memory_order_seq_cst) noexcept
+	{
+		++counted_ops.stores_;
+		value_.store(value, order);
+	}
+
+	T fetch_add(const T arg, const std::memory_order order = std::memory_order_seq_cst) noexcept
+	{
+		++counted_ops.rmws_;
+		return value_.fetch_add(arg, order);
+	}
+
+	T fetch_sub(const T arg, const std::memory_order order = std::memory_order_seq_cst) noexcept
+	{
+		++counted_ops.rmws_;
+		return value_.fetch_sub(arg, order);
+	}
+
+	T fetch_and(const T arg, const std::memory_order order = std::memory_order_seq_cst) noexcept
+	{
+		++counted_ops.rmws_;
+		return value_.fetch_and(arg, order);
+	}
+
+	bool compare_exchange_weak(T& expected, const T desired, const std::memory_order success = std::memory_order_seq_cst, const std::memory_order failure = std::memory_order_seq_cst) noexcept
+	{
+		++counted_ops.rmws_;
+		return value_.compare_exchange_weak(expected, desired, success, failure);
+	}
+
+	bool compare_exchange_strong(T& expected, const T desired, const std::memory_order success = std::memory_order_seq_cst, const std::memory_order failure = std::memory_order_seq_cst) noexcept
+	{
+		++counted_ops.rmws_;
+		return value_.compare_exchange_strong(expected, desired, success, failure);
+	}
+
+	T operator++() noexcept
+	{
+		return fetch_add(1) + 1;
+	}
+
+	T operator--() noexcept
+	{
+		return fetch_sub(1) - 1;
+	}
+};
+
+/// 1, 2, 4 ... up to max_threads (max_threads itself included).
+inline std::vector<int> thread_counts(const int max_threads)
+{
+	std::vector<int> counts;
+	for (int n = 1; n < max_threads; n *= 2)
+	{
+		counts.push_back(n);
+	}
+	counts.push_back(max_threads);
+	return counts;
+}
+
+}
@@ -0,0 +1,63 @@
+#include "bench.h"
+#include "biased_counting.h"
+
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+/// Nanoseconds per copy and destruction on one thread: raw pointer, shared_ptr with atomic counters,
+/// biased_shared_ptr on the thread which created the object and on another thread.
+
+namespace
+{
+
+struct node
+{
+	long value_;
+};
+
+constexpr int copies = 20'000'000;
+
+template<typename Pointer>
+long copy_loop(const Pointer& source)
+{
+	long sum = 0;
+	for (int i = 0; i < copies; ++i)
+	{
+		const Pointer copy = source;  // NOLINT(performance-unnecessary-copy-initialization) // Copy is what is measured.
+		bench::do_not_optimize(copy);
+		sum += copy->value_;
+	}
+	return sum;
+}
+
+template<typename Pointer>
+double nanoseconds_per_copy(const Pointer& source)
+{
+	const auto begin = bench::clock::now();
+	bench::do_not_optimize(copy_loop(source));
+	const auto end = bench::clock::now();
+	return std::chrono::duration<double, std::nano>(end - begin).count() / copies;
+}
+
+}
+
+int main()
+{
+	node raw_node{1};
+	const node* raw = &raw_node;
+	const auto atomic = smart_ptr::make_shared<node>(1);
+	const auto biased = smart_ptr::make_biased_shared<node>(1);
+
+	std::printf("# ns per copy and destruction, one thread\n");
+	std::printf("%-24s %8.2f\n", "raw pointer", nanoseconds_per_copy(raw));
+	std::printf("%-24s %8.2f\n", "shared_ptr", nanoseconds_per_copy(atomic));
+	std::printf("%-24s %8.2f\n", "biased, owner", nanoseconds_per_copy(biased));
+	double other = 0;
+	std::thread([&other, &biased]
+	{
+		other = nanoseconds_per_copy(biased);
+	}).join();
+	std::printf("%-24s %8.2f\n", "biased, other thread", other);
+	return 0;
+}
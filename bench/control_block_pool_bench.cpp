@@ -0,0 +1,163 @@
+#include "bench.h"
+#include "control_block_pool.h"
+#include "shared_ptr.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#if defined(__linux__)
+#include <sys/wait.h>
+#endif
+
+/// Allocations per second and resident memory of the pooled control blocks against plain operator new.
+///
+/// Usage: control_block_pool_bench [max_threads]
+///	- throughput: every thread repeatedly creates a batch of shared_ptrs and destroys it.
+///	- cross-thread: every thread destroys the batch created by its neighbour (blocks go back to other thread's heap).
+///	- footprint: one million live objects, resident memory per object. Every scenario runs in its own process (Linux).
+
+namespace
+{
+
+struct message
+{
+	std::uint64_t words_[4]{};
+};
+
+using ptr = smart_ptr::shared_ptr<message>;
+
+struct scenario
+{
+	const char* name_;
+	ptr (*create_)();
+};
+
+const scenario scenarios[] = {
+	{"new", [] { return ptr(new message); }},
+	{"new + pooled block", [] { return ptr(new message, std::default_delete<message>{}, smart_ptr::pool_allocator<message>{}); }},
+	{"make_shared", [] { return smart_ptr::make_shared<message>(); }},
+	{"allocate_shared pooled", [] { return smart_ptr::allocate_shared<message>(smart_ptr::pool_allocator<message>{}); }},
+	{"allocate_shared huge pages", [] { return smart_ptr::allocate_shared<message>(smart_ptr::pool_allocator<message, true>{}); }},
+};
+
+constexpr int batch_size = 1024;
+constexpr int rounds = 500;
+
+double throughput(const scenario& s, const int threads)
+{
+	const double seconds = bench::run_threads(threads, [&s](int)
+	{
+		std::vector<ptr> batch(batch_size);
+		for (int round = 0; round < rounds; ++round)
+		{
+			for (auto& p : batch)
+			{
+				p = s.create_();
+			}
+			for (auto& p : batch)
+			{
+				p = ptr{};
+			}
+		}
+	});
+	return static_cast<double>(threads) * rounds * batch_size / seconds;
+}
+
+double cross_thread(const scenario& s, const int threads)
+{
+	std::vector<std::vector<ptr>> batches(threads, std::vector<ptr>(batch_size));
+	std::barrier sync(threads);
+	const double seconds = bench::run_threads(threads, [&](const int index)
+	{
+		for (int round = 0; round < rounds; ++round)
+		{
+			for (auto& p : batches[index])
+			{
+				p = s.create_();
+			}
+			sync.arrive_and_wait();
+			for (auto& p : batches[(index + 1) % threads])
+			{
+				p = ptr{};
+			}
+			sync.arrive_and_wait();
+		}
+	});
+	return static_cast<double>(threads) * rounds * batch_size / seconds;
+}
+
+void footprint(const scenario& s)
+{
+	constexpr int live = 1'000'000;
+	std::vector<ptr> objects(live);
+	const std::size_t before = bench::resident_set_bytes();
+	for (auto& p : objects)
+	{
+		p = s.create_();
+	}
+	const std::size_t after = bench::resident_set_bytes();
+	std::printf("%-28s %10.1f MiB %8.1f B/object\n", s.name_, static_cast<double>(after - before) / (1 << 20), static_cast<double>(after - before) / live);
+}
+
+void footprint_isolated(const scenario& s)
+{
+#if defined(__linux__)
+	std::fflush(stdout);
+	if (const pid_t child = ::fork(); child == 0)
+	{
+		footprint(s);
+		std::fflush(stdout);
+		std::_Exit(0);
+	}
+	else if (child > 0)
+	{
+		::waitpid(child, nullptr, 0);
+		return;
+	}
+#endif
+	footprint(s);
+}
+
+}
+
+int main(const int argc, char* argv[])
+{
+	const int max_threads = argc > 1 ? std::atoi(argv[1]) : static_cast<int>(std::thread::hardware_concurrency());
+
+	std::printf("# footprint (resident memory for 1M live objects, sizeof(message) = %zu)\n", sizeof(message));
+	for (const auto& s : scenarios)
+	{
+		footprint_isolated(s);
+	}
+
+	std::printf("\n# allocations per second (millions)\n%-28s", "scenario \\ threads");
+	const auto counts = bench::thread_counts(max_threads);
+	for (const int n : counts)
+	{
+		std::printf(" %8d", n);
+	}
+	std::printf("\n");
+	for (const auto& s : scenarios)
+	{
+		std::printf("%-28s", s.name_);
+		for (const int n : counts)
+		{
+			std::printf(" %8.2f", throughput(s, n) / 1e6);
+		}
+		std::printf("\n");
+	}
+	for (const auto& s : scenarios)
+	{
+		std::printf("%-28s", (std::string(s.name_) + " x-thr").c_str());
+		for (const int n : counts)
+		{
+			std::printf(" %8.2f", cross_thread(s, n) / 1e6);
+		}
+		std::printf("\n");
+	}
+	std::printf("\nresident set at exit: %.1f MiB\n", static_cast<double>(bench::resident_set_bytes()) / (1 << 20));
+	return 0;
+}
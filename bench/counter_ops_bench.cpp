@@ -0,0 +1,135 @@
+#include "bench.h"
+#include "packed_counting.h"
+
+#include <cstdio>
+#include <optional>
+#include <vector>
+
+/// Atomic operations and time per shared_ptr operation, one thread:
+/// atomic_counting (two std::atomic<int>) against packed_counting (one 64 bit word).
+/// Counts come from the policies instantiated with bench::counted_atomic, times from the plain ones.
+
+namespace
+{
+
+struct payload
+{
+	long value_;
+};
+
+template<typename Counting>
+struct state
+{
+	smart_ptr::shared_ptr<payload, Counting> shared_;
+	smart_ptr::shared_ptr<payload, Counting> copy_;
+	std::optional<smart_ptr::weak_ptr<payload, Counting>> weak_;
+};
+
+template<typename Counting>
+state<Counting> unique()
+{
+	return {smart_ptr::make_shared<payload, Counting>(1), {}, {}};
+}
+
+template<typename Counting>
+state<Counting> copied()
+{
+	auto result = unique<Counting>();
+	result.copy_ = result.shared_;
+	return result;
+}
+
+template<typename Counting>
+state<Counting> observed()
+{
+	auto result = unique<Counting>();
+	result.weak_.emplace(result.shared_);
+	return result;
+}
+
+template<typename Counting>
+state<Counting> expired()
+{
+	auto result = observed<Counting>();
+	result.shared_.reset();
+	return result;
+}
+
+constexpr int repetitions = 1'000'000;
+
+template<typename Counting>
+bench::atomic_ops count_ops(state<Counting> (*setup)(), void (*operation)(state<Counting>&))
+{
+	auto subject = setup();
+	const bench::atomic_ops before = bench::counted_ops;
+	operation(subject);
+	const bench::atomic_ops after = bench::counted_ops;
+	return {after.loads_ - before.loads_, after.stores_ - before.stores_, after.rmws_ - before.rmws_};
+}
+
+template<typename Counting>
+double nanoseconds(state<Counting> (*setup)(), void (*operation)(state<Counting>&))
+{
+	std::vector<state<Counting>> subjects;
+	subjects.reserve(repetitions);
+	for (int i = 0; i < repetitions; ++i)
+	{
+		subjects.push_back(setup());
+	}
+	const auto begin = bench::clock::now();
+	for (auto& subject : subjects)
+	{
+		operation(subject);
+	}
+	const auto end = bench::clock::now();
+	return std::chrono::duration<double, std::nano>(end - begin).count() / repetitions;
+}
+
+/// Operations measured. Every one runs on its own fresh state.
+template<typename Counting>
+struct scenario
+{
+	const char* name_;
+	state<Counting> (*setup_)();
+	void (*operation_)(state<Counting>&);
+};
+
+template<typename Counting>
+std::vector<scenario<Counting>> scenarios()
+{
+	return {
+		{"copy", &unique<Counting>, [](state<Counting>& s) { s.copy_ = s.shared_; }},
+		{"release, not last", &copied<Counting>, [](state<Counting>& s) { s.copy_.reset(); }},
+		{"release last, no weak_ptr", &unique<Counting>, [](state<Counting>& s) { s.shared_.reset(); }},
+		{"release last, weak_ptr alive", &observed<Counting>, [](state<Counting>& s) { s.shared_.reset(); }},
+		{"weak_ptr::lock", &observed<Counting>, [](state<Counting>& s) { s.copy_ = s.weak_->lock(); }},
+		{"release last weak_ptr", &expired<Counting>, [](state<Counting>& s) { s.weak_.reset(); }},
+	};
+}
+
+template<template<template<typename> class> class Counting>
+void policy_columns(const int index)
+{
+	const auto counted = scenarios<Counting<bench::counted_atomic>>()[index];
+	const auto plain = scenarios<Counting<std::atomic>>()[index];
+	const bench::atomic_ops ops = count_ops(counted.setup_, counted.operation_);
+	std::printf(" | %4ld %4ld %5ld %6.2f", ops.rmws_, ops.loads_, ops.stores_, nanoseconds(plain.setup_, plain.operation_));
+}
+
+}
+
+int main()
+{
+	std::printf("# atomic operations and ns per operation, one thread\n");
+	std::printf("%-30s | %-23s | %-23s\n", "", "atomic_counting", "packed_counting");
+	std::printf("%-30s | %4s %4s %5s %6s | %4s %4s %5s %6s\n", "operation", "rmw", "load", "store", "ns", "rmw", "load", "store", "ns");
+	const auto names = scenarios<smart_ptr::atomic_counting>();
+	for (int i = 0; i < static_cast<int>(names.size()); ++i)
+	{
+		std::printf("%-30s", names[i].name_);
+		policy_columns<smart_ptr::basic_atomic_counting>(i);
+		policy_columns<smart_ptr::basic_packed_counting>(i);
+		std::printf("\n");
+	}
+	return 0;
+}
@@ -0,0 +1,89 @@
+#include "bench.h"
+#include "deferred_counting.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+/// Batches of shared_ptrs to a few hot objects destroyed in a tight loop, 1 to max_threads threads.
+/// Every thread fills a vector with copies of 4 shared objects, then clears it. deferred_counting flushes after each batch.
+/// Compares atomic_counting (one fetch_sub per destructor) with deferred_counting (one fetch_sub per object and batch).
+///
+/// Usage: deferred_counting_bench [max_threads]
+
+namespace
+{
+
+struct hot
+{
+	long value_;
+};
+
+constexpr int objects = 4;
+constexpr int batch = 1'000;
+constexpr int batches_per_thread = 2'000;
+
+template<typename Counting>
+void flush()
+{
+}
+
+template<>
+void flush<smart_ptr::deferred_counting>()
+{
+	smart_ptr::deferred_flush();
+}
+
+template<typename Counting>
+double releases_per_second(const int threads)
+{
+	std::vector<smart_ptr::shared_ptr<hot, Counting>> shared;
+	for (int i = 0; i < objects; ++i)
+	{
+		shared.push_back(smart_ptr::make_shared<hot, Counting>(i));
+	}
+	const double seconds = bench::run_threads(threads, [&shared](const int index)
+	{
+		std::vector<smart_ptr::shared_ptr<hot, Counting>> copies;
+		copies.reserve(batch);
+		for (int i = 0; i < batches_per_thread; ++i)
+		{
+			for (int j = 0; j < batch; ++j)
+			{
+				copies.push_back(shared[(index + j) % objects]);
+			}
+			copies.clear();
+			flush<Counting>();
+		}
+	});
+	return static_cast<double>(threads) * batches_per_thread * batch / seconds;
+}
+
+template<typename Counting>
+void row(const char* name, const std::vector<int>& counts)
+{
+	std::printf("%-17s", name);
+	for (const int n : counts)
+	{
+		std::printf(" %8.2f", releases_per_second<Counting>(n) / 1e6);
+	}
+	std::printf("\n");
+}
+
+}
+
+int main(const int argc, char* argv[])
+{
+	const int max_threads = argc > 1 ? std::atoi(argv[1]) : 64;
+	const auto counts = bench::thread_counts(max_threads);
+
+	std::printf("# copies and releases per second (millions), %d objects\n%-17s", objects, "policy \\ threads");
+	for (const int n : counts)
+	{
+		std::printf(" %8d", n);
+	}
+	std::printf("\n");
+	row<smart_ptr::atomic_counting>("atomic_counting", counts);
+	row<smart_ptr::deferred_counting>("deferred_counting", counts);
+	return 0;
+}
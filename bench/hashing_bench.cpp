@@ -0,0 +1,160 @@
+#include "bench.h"
+#include "shared_ptr.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+/// Lookups in a flat open-addressing table (linear probing, keys stored in the slots) keyed by shared_ptr.
+/// Compares what a probe has to load:
+///	- payload key: hand-written hasher and equality reading a field of the object, a cache miss per probe.
+///	- std::hash: get(), stored in the shared_ptr itself.
+///	- owner_hash: control block address, stored in the shared_ptr itself.
+/// Objects are many and in random order, so the ones the table points to are not in cache.
+///
+/// Usage: hashing_bench [objects]
+
+namespace
+{
+
+struct record
+{
+	std::uint64_t id_;
+	unsigned char rest_[56];
+};
+
+using key = smart_ptr::shared_ptr<record>;
+
+struct payload_key_hash
+{
+	std::size_t operator()(const key& k) const noexcept
+	{
+		return static_cast<std::size_t>(k->id_);
+	}
+};
+
+struct payload_key_equal
+{
+	bool operator()(const key& lhs, const key& rhs) const noexcept
+	{
+		return lhs->id_ == rhs->id_;
+	}
+};
+
+/// Power of two slots, at most half full. Hash is spread by a multiplication, so identity pointer hashes work.
+template<typename Hash, typename Equal>
+class flat_table
+{
+	struct slot
+	{
+		key key_;
+		int value_{0};
+		bool used_{false};
+	};
+
+	std::vector<slot> slots_;
+	std::size_t mask_;
+	int shift_;
+
+	[[nodiscard]] std::size_t home(const key& k) const noexcept
+	{
+		return static_cast<std::size_t>((static_cast<std::uint64_t>(Hash{}(k)) * 0x9E3779B97F4A7C15ull) >> shift_) & mask_;
+	}
+
+public:
+	explicit flat_table(const std::size_t size)
+	{
+		std::size_t capacity = 2;
+		int bits = 1;
+		while (capacity < 2 * size)
+		{
+			capacity *= 2;
+			++bits;
+		}
+		slots_.resize(capacity);
+		mask_ = capacity - 1;
+		shift_ = 64 - bits;
+	}
+
+	void insert(const key& k, const int value)
+	{
+		for (std::size_t i = home(k);; i = (i + 1) & mask_)
+		{
+			if (!slots_[i].used_)
+			{
+				slots_[i] = {k, value, true};
+				return;
+			}
+		}
+	}
+
+	[[nodiscard]] const int* find(const key& k) const noexcept
+	{
+		for (std::size_t i = home(k);; i = (i + 1) & mask_)
+		{
+			if (!slots_[i].used_)
+			{
+				return nullptr;
+			}
+			if (Equal{}(slots_[i].key_, k))
+			{
+				return &slots_[i].value_;
+			}
+		}
+	}
+};
+
+constexpr int rounds = 5;
+
+template<typename Hash, typename Equal>
+double nanoseconds_per_lookup(const std::vector<key>& objects, const std::vector<key>& lookups)
+{
+	flat_table<Hash, Equal> table(objects.size());
+	for (std::size_t i = 0; i < objects.size(); ++i)
+	{
+		table.insert(objects[i], static_cast<int>(i));
+	}
+	double best = 0.0;
+	for (int round = 0; round < rounds; ++round)
+	{
+		long sum = 0;
+		const auto begin = bench::clock::now();
+		for (const key& k : lookups)
+		{
+			sum += *table.find(k);
+		}
+		const auto end = bench::clock::now();
+		bench::do_not_optimize(sum);
+		const double nanoseconds = std::chrono::duration<double, std::nano>(end - begin).count() / static_cast<double>(lookups.size());
+		best = round == 0 ? nanoseconds : std::min(best, nanoseconds);
+	}
+	return best;
+}
+
+}
+
+int main(const int argc, char* argv[])
+{
+	const std::size_t count = argc > 1 ? static_cast<std::size_t>(std::atoll(argv[1])) : 1 << 20;
+	std::mt19937_64 random(42);
+
+	std::vector<key> objects;
+	objects.reserve(count);
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		objects.push_back(smart_ptr::make_shared<record>(record{random(), {}}));
+	}
+	// Copies of the keys, in an order unrelated to allocation and table order.
+	std::vector<key> lookups = objects;
+	std::shuffle(lookups.begin(), lookups.end(), random);
+
+	std::printf("# %zu objects of %zu bytes, table half full, best of %d rounds\n", count, sizeof(record), rounds);
+	std::printf("%-14s %10s\n", "hash", "ns/lookup");
+	std::printf("%-14s %10.2f\n", "payload key", nanoseconds_per_lookup<payload_key_hash, payload_key_equal>(objects, lookups));
+	std::printf("%-14s %10.2f\n", "std::hash", nanoseconds_per_lookup<std::hash<key>, std::equal_to<key>>(objects, lookups));
+	std::printf("%-14s %10.2f\n", "owner_hash", nanoseconds_per_lookup<smart_ptr::owner_hash, smart_ptr::owner_equal>(objects, lookups));
+	return 0;
+}
@@ -0,0 +1,314 @@
+#include "bench.h"
+#include "shared_ptr.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+/// Pointer chasing through linked nodes, one thread. Compares the layout of shared_ptr.h, which keeps the pointer
+/// get() returns next to the control block pointer (16 bytes, one load to the object), with a handle of the control
+/// block pointer only (8 bytes, get() loads payload_ from the block first). Every node is visited in random memory order.
+///	- walk: borrowed traversal of the list, no counting. Dereference cost only.
+///	- copy walk: a copy of every visited node, so both layouts touch the control blocks.
+///	- scan: vector of handles, in list order. The 16-byte layout reads twice as many handle bytes.
+/// Allocation: make_shared (object inside the block) or new (object and block allocated apart, block order shuffled).
+///
+/// Usage: layout_bench [max_nodes]
+
+namespace
+{
+
+/// Handle as shared_ptr was before it stored get() next to the control block.
+template<typename T>
+class compact_ptr
+{
+	using control_block = smart_ptr::detail::control_block<smart_ptr::atomic_counting>;
+	using action = typename control_block::action;
+
+	/// Object inside the block, as make_shared.
+	struct fused_block : control_block
+	{
+		alignas(T) unsigned char storage_[sizeof(T)];
+
+		fused_block()
+			: control_block(&storage_, &manage)
+		{
+			::new (static_cast<void*>(&storage_)) T();
+		}
+
+		static void manage(control_block* control, const action what) noexcept
+		{
+			if (what == action::destroy_payload)
+			{
+				std::destroy_at(static_cast<T*>(control->payload_));
+			}
+			else
+			{
+				delete static_cast<fused_block*>(control);
+			}
+		}
+	};
+
+	static void manage_separate(control_block* control, const action what) noexcept
+	{
+		if (what == action::destroy_payload)
+		{
+			delete static_cast<T*>(control->payload_);
+		}
+		else
+		{
+			delete control;
+		}
+	}
+
+	control_block* control_{nullptr};
+
+	explicit compact_ptr(control_block* control) noexcept
+		: control_(control)
+	{
+	}
+
+public:
+	compact_ptr() noexcept = default;
+
+	static compact_ptr make()
+	{
+		return compact_ptr(new fused_block());
+	}
+
+	static compact_ptr adopt(T* payload)
+	{
+		return compact_ptr(new control_block(payload, &manage_separate));
+	}
+
+	compact_ptr(const compact_ptr& other) noexcept
+		: control_(other.control_)
+	{
+		if (control_)
+		{
+			control_->add_strong();
+		}
+	}
+
+	compact_ptr(compact_ptr&& other) noexcept
+		: control_(std::exchange(other.control_, nullptr))
+	{
+	}
+
+	compact_ptr& operator=(compact_ptr other) noexcept
+	{
+		std::swap(control_, other.control_);
+		return *this;
+	}
+
+	~compact_ptr()
+	{
+		if (control_ && control_->release_strong())
+		{
+			smart_ptr::detail::finish_strong(control_);
+		}
+	}
+
+	[[nodiscard]] T* get() const noexcept
+	{
+		return control_ ? static_cast<T*>(control_->payload_) : nullptr;
+	}
+
+	[[nodiscard]] T* operator->() const noexcept
+	{
+		return get();
+	}
+
+	[[nodiscard]] explicit operator bool() const noexcept
+	{
+		return control_ != nullptr;
+	}
+};
+
+struct inline_layout
+{
+	static constexpr const char* name = "inline";
+
+	template<typename T>
+	using handle = smart_ptr::shared_ptr<T>;
+
+	template<typename T>
+	static handle<T> make()
+	{
+		return smart_ptr::make_shared<T>();
+	}
+
+	template<typename T>
+	static handle<T> adopt(T* payload)
+	{
+		return handle<T>(payload);
+	}
+};
+
+struct compact_layout
+{
+	static constexpr const char* name = "compact";
+
+	template<typename T>
+	using handle = compact_ptr<T>;
+
+	template<typename T>
+	static handle<T> make()
+	{
+		return compact_ptr<T>::make();
+	}
+
+	template<typename T>
+	static handle<T> adopt(T* payload)
+	{
+		return compact_ptr<T>::adopt(payload);
+	}
+};
+
+template<typename Layout>
+struct node
+{
+	typename Layout::template handle<node> next_;
+	long value_{0};
+};
+
+/// Nodes linked in random order. Owned by nodes_ too, so the list is torn down without recursion.
+template<typename Layout>
+class linked_nodes
+{
+	using handle = typename Layout::template handle<node<Layout>>;
+
+	std::vector<handle> nodes_;
+
+public:
+	linked_nodes(const std::size_t count, const bool fused)
+	{
+		std::mt19937 random(7);
+		std::vector<std::size_t> order(count);
+		std::iota(order.begin(), order.end(), std::size_t{0});
+		std::vector<handle> allocated(count);
+		if (fused)
+		{
+			for (handle& h : allocated)
+			{
+				h = Layout::template make<node<Layout>>();
+			}
+		}
+		else
+		{
+			std::vector<node<Layout>*> payloads(count);
+			for (auto*& payload : payloads)
+			{
+				payload = new node<Layout>();
+			}
+			// Blocks are allocated after all objects and in another order: object and block are far apart.
+			std::shuffle(order.begin(), order.end(), random);
+			for (const std::size_t i : order)
+			{
+				allocated[i] = Layout::adopt(payloads[i]);
+			}
+		}
+		std::shuffle(order.begin(), order.end(), random);
+		nodes_.reserve(count);
+		for (const std::size_t i : order)
+		{
+			allocated[i]->value_ = static_cast<long>(nodes_.size());
+			nodes_.push_back(std::move(allocated[i]));
+		}
+		for (std::size_t i = 0; i + 1 < count; ++i)
+		{
+			nodes_[i]->next_ = nodes_[i + 1];
+		}
+	}
+
+	~linked_nodes()
+	{
+		for (handle& h : nodes_)
+		{
+			h->next_ = handle{};
+		}
+	}
+
+	linked_nodes(const linked_nodes&) = delete;
+	linked_nodes& operator=(const linked_nodes&) = delete;
+
+	[[nodiscard]] long walk() const
+	{
+		long sum = 0;
+		for (const handle* link = &nodes_.front(); *link; link = &(*link)->next_)
+		{
+			sum += (*link)->value_;
+		}
+		return sum;
+	}
+
+	[[nodiscard]] long copy_walk() const
+	{
+		long sum = 0;
+		for (handle current = nodes_.front(); current; current = current->next_)
+		{
+			sum += current->value_;
+		}
+		return sum;
+	}
+
+	[[nodiscard]] long scan() const
+	{
+		long sum = 0;
+		for (const handle& h : nodes_)
+		{
+			sum += h->value_;
+		}
+		return sum;
+	}
+};
+
+constexpr int rounds = 5;
+
+/// Best of rounds passes, ns per node.
+template<typename Structure, typename Pass>
+double per_node(const Structure& structure, const std::size_t count, Pass pass)
+{
+	double best = 0.0;
+	for (int round = 0; round < rounds; ++round)
+	{
+		const auto begin = bench::clock::now();
+		bench::do_not_optimize((structure.*pass)());
+		const auto end = bench::clock::now();
+		const double nanoseconds = std::chrono::duration<double, std::nano>(end - begin).count() / static_cast<double>(count);
+		best = round == 0 ? nanoseconds : std::min(best, nanoseconds);
+	}
+	return best;
+}
+
+template<typename Layout>
+void row(const std::size_t count, const bool fused)
+{
+	const linked_nodes<Layout> structure(count, fused);
+	std::printf("%-8s %-12s %5zu %9zu %8.2f %10.2f %8.2f\n", Layout::name, fused ? "make_shared" : "new", sizeof(typename Layout::template handle<int>), count,
+		per_node(structure, count, &linked_nodes<Layout>::walk),
+		per_node(structure, count, &linked_nodes<Layout>::copy_walk),
+		per_node(structure, count, &linked_nodes<Layout>::scan));
+}
+
+}
+
+int main(const int argc, char* argv[])
+{
+	const std::size_t max_nodes = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : std::size_t{1} << 20;
+	std::printf("# ns per node, best of %d passes. inline: shared_ptr.h, compact: control block pointer only\n", rounds);
+	std::printf("%-8s %-12s %5s %9s %8s %10s %8s\n", "layout", "allocation", "bytes", "nodes", "walk", "copy walk", "scan");
+	for (std::size_t count = 1024; count <= max_nodes; count *= 32)
+	{
+		for (const bool fused : {true, false})
+		{
+			row<inline_layout>(count, fused);
+			row<compact_layout>(count, fused);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,88 @@
+#include "bench.h"
+#include "biased_counting.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+/// Copy heavy traversal of a tree built of shared pointers, one thread.
+/// Every visited child is copied onto the traversal stack and destroyed when popped.
+/// Compares the counting policies: atomic_counting (shared_ptr), local_counting (local_shared_ptr) and biased_counting.
+///
+/// Usage: local_shared_ptr_bench [depth]
+
+namespace
+{
+
+template<typename Counting>
+struct tree_node
+{
+	long value_;
+	smart_ptr::shared_ptr<tree_node, Counting> left_;
+	smart_ptr::shared_ptr<tree_node, Counting> right_;
+};
+
+template<typename Counting>
+smart_ptr::shared_ptr<tree_node<Counting>, Counting> build(const int depth, long& next_value)
+{
+	auto node = smart_ptr::make_shared<tree_node<Counting>, Counting>(next_value++);
+	if (depth > 1)
+	{
+		node->left_ = build<Counting>(depth - 1, next_value);
+		node->right_ = build<Counting>(depth - 1, next_value);
+	}
+	return node;
+}
+
+template<typename Counting>
+long traverse(const smart_ptr::shared_ptr<tree_node<Counting>, Counting>& root, std::vector<smart_ptr::shared_ptr<tree_node<Counting>, Counting>>& stack)
+{
+	long sum = 0;
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		const auto node = std::move(stack.back());
+		stack.pop_back();
+		sum += node->value_;
+		if (node->left_)
+		{
+			stack.push_back(node->left_);
+		}
+		if (node->right_)
+		{
+			stack.push_back(node->right_);
+		}
+	}
+	return sum;
+}
+
+template<typename Counting>
+void row(const char* name, const int depth)
+{
+	long next_value = 0;
+	const auto root = build<Counting>(depth, next_value);
+	std::vector<smart_ptr::shared_ptr<tree_node<Counting>, Counting>> stack;
+	stack.reserve(static_cast<std::size_t>(depth) * 2);
+	constexpr int rounds = 20;
+	bench::do_not_optimize(traverse(root, stack));
+	const auto begin = bench::clock::now();
+	for (int i = 0; i < rounds; ++i)
+	{
+		bench::do_not_optimize(traverse(root, stack));
+	}
+	const auto end = bench::clock::now();
+	const double nanoseconds = std::chrono::duration<double, std::nano>(end - begin).count();
+	std::printf("%-20s %8.2f\n", name, nanoseconds / (static_cast<double>(rounds) * next_value));
+}
+
+}
+
+int main(const int argc, char* argv[])
+{
+	const int depth = argc > 1 ? std::atoi(argv[1]) : 18;
+	std::printf("# ns per visited node, tree of depth %d\n", depth);
+	row<smart_ptr::atomic_counting>("shared_ptr", depth);
+	row<smart_ptr::local_counting>("local_shared_ptr", depth);
+	row<smart_ptr::biased_counting>("biased_shared_ptr", depth);
+	return 0;
+}
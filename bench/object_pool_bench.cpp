@@ -0,0 +1,95 @@
+#include "bench.h"
+#include "object_pool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+/// Messages with a 256 byte body, made and released in batches: make_shared (new object and buffer every time)
+/// against object_pool (recycled object, buffer kept). Nanoseconds per message.
+///	- same thread: the producer releases its own batch.
+///	- other thread: a thread started per batch (start included) releases it, the pool takes the messages back
+///	  from its return stack.
+///
+/// Usage: object_pool_bench [batches]
+
+namespace
+{
+
+struct message
+{
+	std::vector<char> body_;
+	long id_{0};
+
+	message()
+		: body_(256)
+	{
+	}
+};
+
+constexpr int batch_size = 256;
+
+/// Fills a message as a producer would. A recycled body keeps its capacity.
+void fill(message& m, const long id)
+{
+	m.id_ = id;
+	m.body_.assign(256, static_cast<char>(id));
+}
+
+template<typename Make>
+double same_thread(const int batches, Make&& make)
+{
+	std::vector<smart_ptr::shared_ptr<message>> batch;
+	batch.reserve(batch_size);
+	const auto begin = bench::clock::now();
+	for (int b = 0; b < batches; ++b)
+	{
+		for (int i = 0; i < batch_size; ++i)
+		{
+			batch.push_back(make());
+			fill(*batch.back(), i);
+		}
+		batch.clear();
+	}
+	const auto end = bench::clock::now();
+	return std::chrono::duration<double, std::nano>(end - begin).count() / (static_cast<double>(batches) * batch_size);
+}
+
+template<typename Make>
+double other_thread(const int batches, Make&& make)
+{
+	const auto begin = bench::clock::now();
+	for (int b = 0; b < batches; ++b)
+	{
+		std::vector<smart_ptr::shared_ptr<message>> batch;
+		batch.reserve(batch_size);
+		for (int i = 0; i < batch_size; ++i)
+		{
+			batch.push_back(make());
+			fill(*batch.back(), i);
+		}
+		std::thread([released = std::move(batch)]() mutable { released.clear(); }).join();
+	}
+	const auto end = bench::clock::now();
+	return std::chrono::duration<double, std::nano>(end - begin).count() / (static_cast<double>(batches) * batch_size);
+}
+
+}
+
+int main(const int argc, char* argv[])
+{
+	const int batches = argc > 1 ? std::atoi(argv[1]) : 4'000;
+	smart_ptr::object_pool<message> pool(batch_size);
+	pool.warm_up(batch_size);
+	const auto pooled = [&pool] { return pool.acquire(); };
+	const auto made = [] { return smart_ptr::make_shared<message>(); };
+
+	std::printf("# ns per message, batches of %d\n%-14s %12s %12s\n", batch_size, "", "same thread", "other thread");
+	std::printf("%-14s %12.2f %12.2f\n", "make_shared", same_thread(batches, made), other_thread(batches / 20, made));
+	std::printf("%-14s %12.2f %12.2f\n", "object_pool", same_thread(batches, pooled), other_thread(batches / 20, pooled));
+	const auto stats = pool.stats();
+	std::printf("# pool: created %zu, acquired %zu, recycled %zu, returned %zu (%zu by other threads), trimmed %zu\n",
+		stats.created_, stats.acquired_, stats.recycled_, stats.returned_, stats.returned_remote_, stats.trimmed_);
+	return 0;
+}
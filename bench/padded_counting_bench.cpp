@@ -0,0 +1,79 @@
+#include "bench.h"
+#include "shared_ptr.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+/// Mixed strong and weak traffic on one hot object, 1 to max_threads threads.
+///	- even threads: copy the shared_ptr, read the payload, destroy the copy (usages_ and payload pointer).
+///	- odd threads: create and destroy a weak_ptr to it (weak_usages_ only).
+/// Compares atomic_counting (both counters and payload pointer on one cache line) with padded_counting.
+///
+/// Usage: padded_counting_bench [max_threads]
+
+namespace
+{
+
+struct hot
+{
+	long value_;
+};
+
+constexpr int operations_per_thread = 2'000'000;
+
+template<typename Counting>
+double operations_per_second(const int threads)
+{
+	const auto shared = smart_ptr::make_shared<hot, Counting>(1);
+	const double seconds = bench::run_threads(threads, [&shared](const int index)
+	{
+		long sum = 0;
+		if (index % 2 == 0)
+		{
+			for (int i = 0; i < operations_per_thread; ++i)
+			{
+				const auto copy = shared;  // NOLINT(performance-unnecessary-copy-initialization) // Copy is what is measured.
+				sum += copy->value_;
+			}
+		}
+		else
+		{
+			for (int i = 0; i < operations_per_thread; ++i)
+			{
+				const smart_ptr::weak_ptr<hot, Counting> observer(shared);
+				bench::do_not_optimize(observer);
+			}
+		}
+		bench::do_not_optimize(sum);
+	});
+	return static_cast<double>(threads) * operations_per_thread / seconds;
+}
+
+template<typename Counting>
+void row(const char* name, const std::vector<int>& counts)
+{
+	std::printf("%-16s", name);
+	for (const int n : counts)
+	{
+		std::printf(" %8.2f", operations_per_second<Counting>(n) / 1e6);
+	}
+	std::printf("\n");
+}
+
+}
+
+int main(const int argc, char* argv[])
+{
+	const int max_threads = argc > 1 ? std::atoi(argv[1]) : 64;
+	const auto counts = bench::thread_counts(max_threads);
+
+	std::printf("# operations per second (millions), half strong copies, half weak_ptr create and destroy\n%-16s", "policy \\ threads");
+	for (const int n : counts)
+	{
+		std::printf(" %8d", n);
+	}
+	std::printf("\n");
+	row<smart_ptr::atomic_counting>("atomic_counting", counts);
+	row<smart_ptr::padded_counting>("padded_counting", counts);
+	return 0;
+}
@@ -0,0 +1,155 @@
+#include "bench.h"
+#include "atomic_shared_ptr.h"
+#include "epoch.h"
+#include "hazard_pointer.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+/// Read path cost of the ways to read a published object, 1 to 128 threads:
+///	- refcount copy: copy of one shared shared_ptr (increment and decrement of usages_ of the same block).
+///	- split count: atomic_shared_ptr::load (one CAS on the slot, decrement of usages_ at the end).
+///	- hazard pointer: hazard_shared_slot::read (store to the hazard record of this thread, no RMW).
+///	- epoch: epoch_guard and atomic_shared_ptr::borrow (two stores per guard, plain load per borrow).
+///
+/// Usage: reclamation_bench [max_threads] [reads_per_guard]
+/// Thread 0 publishes a new object every write_every reads.
+
+namespace
+{
+
+struct route
+{
+	long version_;
+	long hops_[7]{};
+};
+
+constexpr int reads_per_thread = 200'000;
+constexpr int write_every = 1024;
+
+struct refcount_copy
+{
+	smart_ptr::shared_ptr<route> shared_{smart_ptr::make_shared<route>(0)};
+
+	long read(int)
+	{
+		const auto copy = shared_;  // NOLINT(performance-unnecessary-copy-initialization) // Copy is what is measured.
+		return copy->version_;
+	}
+
+	void write(long)
+	{
+		// Plain shared_ptr can not be replaced while other threads copy it.
+	}
+};
+
+struct split_count
+{
+	smart_ptr::atomic_shared_ptr<route> slot_{smart_ptr::make_shared<route>(0)};
+
+	long read(int)
+	{
+		return slot_.load()->version_;
+	}
+
+	void write(const long version)
+	{
+		slot_.store(smart_ptr::make_shared<route>(version));
+	}
+};
+
+struct hazard
+{
+	smart_ptr::hazard_shared_slot<route> slot_{smart_ptr::make_shared<route>(0)};
+
+	long read(const int batch)
+	{
+		long sum = 0;
+		for (int i = 0; i < batch; ++i)
+		{
+			sum += slot_.read()->version_;
+		}
+		return sum;
+	}
+
+	void write(const long version)
+	{
+		slot_.store(smart_ptr::make_shared<route>(version));
+	}
+};
+
+struct epoch
+{
+	smart_ptr::atomic_shared_ptr<route> slot_{smart_ptr::make_epoch_shared<route>(0)};
+
+	long read(const int batch)
+	{
+		const smart_ptr::epoch_guard guard;
+		long sum = 0;
+		for (int i = 0; i < batch; ++i)
+		{
+			sum += slot_.borrow(guard)->version_;
+		}
+		return sum;
+	}
+
+	void write(const long version)
+	{
+		slot_.store(smart_ptr::make_epoch_shared<route>(version));
+	}
+};
+
+template<typename Reader>
+double reads_per_second(const int threads, const int batch)
+{
+	Reader reader;
+	const int batches = reads_per_thread / batch;
+	const double seconds = bench::run_threads(threads, [&reader, batch, batches](const int index)
+	{
+		long sum = 0;
+		for (int i = 0; i < batches; ++i)
+		{
+			sum += reader.read(batch);
+			if (index == 0 && (i * batch) % write_every < batch)
+			{
+				reader.write(i);
+			}
+		}
+		bench::do_not_optimize(sum);
+	});
+	smart_ptr::hazard_pointer_clean_up();
+	smart_ptr::epoch_clean_up();
+	return static_cast<double>(threads) * batches * batch / seconds;
+}
+
+template<typename Reader>
+void row(const char* name, const std::vector<int>& counts, const int batch)
+{
+	std::printf("%-16s", name);
+	for (const int n : counts)
+	{
+		std::printf(" %8.2f", reads_per_second<Reader>(n, batch) / 1e6);
+	}
+	std::printf("\n");
+}
+
+}
+
+int main(const int argc, char* argv[])
+{
+	const int max_threads = argc > 1 ? std::atoi(argv[1]) : 128;
+	const int batch = argc > 2 ? std::atoi(argv[2]) : 1;
+	const auto counts = bench::thread_counts(max_threads);
+
+	std::printf("# reads per second (millions), %d read(s) per guard\n%-16s", batch, "reader \\ threads");
+	for (const int n : counts)
+	{
+		std::printf(" %8d", n);
+	}
+	std::printf("\n");
+	row<refcount_copy>("refcount copy", counts, 1);
+	row<split_count>("split count", counts, 1);
+	row<hazard>("hazard pointer", counts, batch);
+	row<epoch>("epoch", counts, batch);
+	return 0;
+}
@@ -0,0 +1,279 @@
+#include "bench.h"
+#include "shared_ptr.h"
+
+#include <algorithm>
+#include <barrier>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/// Scaling of shared_ptr.h with 1, 2, 4 ... max_threads threads, pinned one per CPU. CSV on stdout, ready to plot.
+///	- shared: every thread copies and destroys a copy of one object.
+///	- disjoint: every thread copies and destroys a copy of its own object.
+///	- mixed 90/10: shared, but every tenth operation is weak_ptr::lock of the object instead of a copy.
+///	- lock vs last release: rounds of paralelism.md. Thread 0 destroys the last shared_ptr while the others
+///	  lock weak_ptrs to it until they fail (at most locks_per_round times). Operations are the release and the locks.
+/// Throughput is operations of all threads per second. Latency of every sample_every-th operation is timed,
+/// clock overhead (median of timing nothing) subtracted, and reported as p50, p99 and p999.
+/// Same operation counts and thread placement on every run.
+///
+/// Usage: scaling_bench [max_threads] [--no-pin]
+
+namespace
+{
+
+struct hot
+{
+	long value_;
+};
+
+constexpr int operations_per_thread = 1'000'000;
+constexpr int race_rounds = 20'000;
+/// Bounds a round when there are more threads than CPUs and the releasing thread waits for a time slice.
+constexpr int locks_per_round = 64;
+constexpr int sample_every = 16;
+
+double clock_overhead = 0.0;
+
+/// Operations of one thread and the latencies sampled from them.
+class recorder
+{
+	std::vector<double> samples_;
+	long operations_{0};
+
+public:
+	recorder()
+	{
+		samples_.reserve(operations_per_thread / sample_every + 1);
+	}
+
+	template<typename Operation>
+	void operator()(Operation&& operation)
+	{
+		if (operations_++ % sample_every != 0)
+		{
+			operation();
+			return;
+		}
+		const auto begin = bench::clock::now();
+		operation();
+		const auto end = bench::clock::now();
+		samples_.push_back(std::max(0.0, std::chrono::duration<double, std::nano>(end - begin).count() - clock_overhead));
+	}
+
+	[[nodiscard]] long operations() const noexcept
+	{
+		return operations_;
+	}
+
+	[[nodiscard]] const std::vector<double>& samples() const noexcept
+	{
+		return samples_;
+	}
+};
+
+struct outcome
+{
+	double operations_per_second_;
+	double p50_;
+	double p99_;
+	double p999_;
+};
+
+outcome summarize(const double seconds, const std::vector<recorder>& recorders)
+{
+	long operations = 0;
+	std::vector<double> samples;
+	for (const recorder& r : recorders)
+	{
+		operations += r.operations();
+		samples.insert(samples.end(), r.samples().begin(), r.samples().end());
+	}
+	std::sort(samples.begin(), samples.end());
+	const auto percentile = [&samples](const double fraction)
+	{
+		return samples.empty() ? 0.0 : samples[std::min(samples.size() - 1, static_cast<std::size_t>(fraction * static_cast<double>(samples.size())))];
+	};
+	return {static_cast<double>(operations) / seconds, percentile(0.5), percentile(0.99), percentile(0.999)};
+}
+
+template<typename Counting>
+void copy_and_destroy(const smart_ptr::shared_ptr<hot, Counting>& shared, long& sum)
+{
+	const auto copy = shared;  // NOLINT(performance-unnecessary-copy-initialization) // Copy is what is measured.
+	sum += copy->value_;
+}
+
+template<typename Counting>
+outcome shared_object(const int threads, const bool pin)
+{
+	const auto shared = smart_ptr::make_shared<hot, Counting>(1);
+	std::vector<recorder> recorders(threads);
+	const double seconds = bench::run_threads(threads, [&](const int index)
+	{
+		long sum = 0;
+		for (int i = 0; i < operations_per_thread; ++i)
+		{
+			recorders[index]([&] { copy_and_destroy(shared, sum); });
+		}
+		bench::do_not_optimize(sum);
+	}, pin);
+	return summarize(seconds, recorders);
+}
+
+template<typename Counting>
+outcome disjoint_objects(const int threads, const bool pin)
+{
+	std::vector<recorder> recorders(threads);
+	const double seconds = bench::run_threads(threads, [&](const int index)
+	{
+		// Allocated by its thread, so objects of different threads do not share a cache line.
+		const auto own = smart_ptr::make_shared<hot, Counting>(1);
+		long sum = 0;
+		for (int i = 0; i < operations_per_thread; ++i)
+		{
+			recorders[index]([&] { copy_and_destroy(own, sum); });
+		}
+		bench::do_not_optimize(sum);
+	}, pin);
+	return summarize(seconds, recorders);
+}
+
+template<typename Counting>
+outcome mixed_strong_weak(const int threads, const bool pin)
+{
+	const auto shared = smart_ptr::make_shared<hot, Counting>(1);
+	std::vector<recorder> recorders(threads);
+	const double seconds = bench::run_threads(threads, [&](const int index)
+	{
+		smart_ptr::weak_ptr<hot, Counting> weak(shared);
+		long sum = 0;
+		for (int i = 0; i < operations_per_thread; ++i)
+		{
+			if (i % 10 == 9)
+			{
+				recorders[index]([&] { sum += weak.lock()->value_; });
+			}
+			else
+			{
+				recorders[index]([&] { copy_and_destroy(shared, sum); });
+			}
+		}
+		bench::do_not_optimize(sum);
+	}, pin);
+	return summarize(seconds, recorders);
+}
+
+template<typename Counting>
+outcome lock_against_release(const int threads, const bool pin)
+{
+	smart_ptr::shared_ptr<hot, Counting> last;
+	std::unique_ptr<smart_ptr::weak_ptr<hot, Counting>> weak;
+	// Completion step runs on one thread while the others wait: sets up the next round.
+	const auto next_round = [&]() noexcept
+	{
+		last = smart_ptr::make_shared<hot, Counting>(1);
+		weak = std::make_unique<smart_ptr::weak_ptr<hot, Counting>>(last);
+	};
+	next_round();
+	std::barrier round(threads, next_round);
+	std::vector<recorder> recorders(threads);
+	const double seconds = bench::run_threads(threads, [&](const int index)
+	{
+		long sum = 0;
+		for (int r = 0; r < race_rounds; ++r)
+		{
+			if (index == 0)
+			{
+				recorders[index]([&] { last.reset(); });
+			}
+			else
+			{
+				auto observer = *weak;
+				bool alive = true;
+				for (int i = 0; alive && i < locks_per_round; ++i)
+				{
+					recorders[index]([&]
+					{
+						const auto locked = observer.lock();
+						alive = static_cast<bool>(locked);
+						sum += alive ? locked->value_ : 0;
+					});
+				}
+			}
+			round.arrive_and_wait();
+		}
+		bench::do_not_optimize(sum);
+	}, pin);
+	return summarize(seconds, recorders);
+}
+
+void calibrate_clock()
+{
+	std::vector<double> empty(10'001);
+	for (double& sample : empty)
+	{
+		const auto begin = bench::clock::now();
+		const auto end = bench::clock::now();
+		sample = std::chrono::duration<double, std::nano>(end - begin).count();
+	}
+	std::nth_element(empty.begin(), empty.begin() + empty.size() / 2, empty.end());
+	clock_overhead = empty[empty.size() / 2];
+}
+
+template<typename Counting>
+void rows(const char* policy, const std::vector<int>& counts, const bool pin)
+{
+	struct scenario
+	{
+		const char* name_;
+		outcome (*run_)(int, bool);
+	};
+	const scenario scenarios[] = {
+		{"shared", &shared_object<Counting>},
+		{"disjoint", &disjoint_objects<Counting>},
+		{"mixed 90/10", &mixed_strong_weak<Counting>},
+		{"lock vs last release", &lock_against_release<Counting>},
+	};
+	for (const scenario& s : scenarios)
+	{
+		for (const int n : counts)
+		{
+			const outcome o = s.run_(n, pin);
+			std::printf("%s,%s,%d,%.0f,%.1f,%.1f,%.1f\n", s.name_, policy, n, o.operations_per_second_, o.p50_, o.p99_, o.p999_);
+			std::fflush(stdout);
+		}
+	}
+}
+
+}
+
+int main(const int argc, char* argv[])
+{
+	int max_threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+	bool pin = true;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--no-pin") == 0)
+		{
+			pin = false;
+		}
+		else
+		{
+			max_threads = std::atoi(argv[i]);
+		}
+	}
+	// Main thread only waits for the workers. Pinning it tells whether pinning works here.
+	const bool pinned = pin && bench::pin_current_thread(0);
+	calibrate_clock();
+	std::printf("# cpus %u, pinned %s, clock overhead %.1f ns subtracted, latency of every %dth operation\n",
+		std::thread::hardware_concurrency(), pinned ? "yes" : "no", clock_overhead, sample_every);
+	std::printf("scenario,policy,threads,ops_per_second,p50_ns,p99_ns,p999_ns\n");
+	const auto counts = bench::thread_counts(max_threads);
+	rows<smart_ptr::atomic_counting>("atomic_counting", counts, pin);
+	rows<smart_ptr::padded_counting>("padded_counting", counts, pin);
+	return 0;
+}
@@ -0,0 +1,70 @@
+#include "bench.h"
+#include "sharded_counting.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+/// One globally hot object copied by every thread, 1 to max_threads threads.
+/// Every thread keeps its own copy for the whole run (as a worker keeps its configuration), then repeatedly
+/// copies the global shared_ptr, reads the payload and destroys the copy.
+/// Compares atomic_counting (one counter for all threads) with sharded_counting (counter of the thread's shard).
+///
+/// Usage: sharded_counting_bench [max_threads]
+
+namespace
+{
+
+struct hot
+{
+	long value_;
+};
+
+constexpr int copies_per_thread = 2'000'000;
+
+template<typename Counting>
+double copies_per_second(const int threads)
+{
+	const auto shared = smart_ptr::make_shared<hot, Counting>(1);
+	const double seconds = bench::run_threads(threads, [&shared](int)
+	{
+		const auto anchor = shared;  // NOLINT(performance-unnecessary-copy-initialization) // Keeps the shard of this thread non-zero.
+		long sum = 0;
+		for (int i = 0; i < copies_per_thread; ++i)
+		{
+			const auto copy = shared;  // NOLINT(performance-unnecessary-copy-initialization) // Copy is what is measured.
+			sum += copy->value_;
+		}
+		bench::do_not_optimize(sum);
+		bench::do_not_optimize(anchor);
+	});
+	return static_cast<double>(threads) * copies_per_thread / seconds;
+}
+
+template<typename Counting>
+void row(const char* name, const std::vector<int>& counts)
+{
+	std::printf("%-16s", name);
+	for (const int n : counts)
+	{
+		std::printf(" %8.2f", copies_per_second<Counting>(n) / 1e6);
+	}
+	std::printf("\n");
+}
+
+}
+
+int main(const int argc, char* argv[])
+{
+	const int max_threads = argc > 1 ? std::atoi(argv[1]) : 64;
+	const auto counts = bench::thread_counts(max_threads);
+
+	std::printf("# copies per second (millions) of one shared_ptr\n%-16s", "policy \\ threads");
+	for (const int n : counts)
+	{
+		std::printf(" %8d", n);
+	}
+	std::printf("\n");
+	row<smart_ptr::atomic_counting>("atomic_counting", counts);
+	row<smart_ptr::sharded_counting>("sharded_counting", counts);
+	return 0;
+}
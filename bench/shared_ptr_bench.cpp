@@ -0,0 +1,260 @@
+#include "bench.h"
+#include "shared_ptr.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+/// Nanoseconds per operation of smart_ptr::shared_ptr and std::shared_ptr, one thread, payloads of 8, 64 and 512 bytes.
+/// Every operation runs once on each of batch fresh states, best of rounds batches.
+///	- Hardware counters per operation (cycles, instructions, cache misses) where perf_event_open is permitted.
+///	- Atomic operations per operation for smart_ptr, counted by the policy instantiated with bench::counted_atomic.
+/// --json prints one object per result, for tracking regressions between commits.
+///
+/// Usage: shared_ptr_bench [--json]
+
+namespace
+{
+
+template<std::size_t Size>
+struct payload
+{
+	unsigned char bytes_[Size];
+};
+
+template<typename Counting>
+struct smart_library
+{
+	static constexpr const char* name = "smart_ptr";
+
+	template<typename T>
+	using shared = smart_ptr::shared_ptr<T, Counting>;
+	template<typename T>
+	using weak = smart_ptr::weak_ptr<T, Counting>;
+
+	template<typename T>
+	static shared<T> make()
+	{
+		return smart_ptr::make_shared<T, Counting>();
+	}
+};
+
+struct std_library
+{
+	static constexpr const char* name = "std";
+
+	template<typename T>
+	using shared = std::shared_ptr<T>;
+	template<typename T>
+	using weak = std::weak_ptr<T>;
+
+	template<typename T>
+	static shared<T> make()
+	{
+		return std::make_shared<T>();
+	}
+};
+
+template<typename Library, typename T>
+struct state
+{
+	typename Library::template shared<T> shared_;
+	typename Library::template shared<T> copy_;
+	std::optional<typename Library::template weak<T>> weak_;
+	long sink_{0};
+};
+
+template<typename Library, typename T>
+void empty(state<Library, T>&)
+{
+}
+
+template<typename Library, typename T>
+void unique(state<Library, T>& s)
+{
+	s.shared_ = Library::template make<T>();
+}
+
+template<typename Library, typename T>
+void copied(state<Library, T>& s)
+{
+	unique(s);
+	s.copy_ = s.shared_;
+}
+
+template<typename Library, typename T>
+void observed(state<Library, T>& s)
+{
+	unique(s);
+	s.weak_.emplace(s.shared_);
+}
+
+/// Operation measured and the setup of its state.
+template<typename Library, typename T>
+struct scenario
+{
+	const char* name_;
+	void (*setup_)(state<Library, T>&);
+	void (*operation_)(state<Library, T>&);
+};
+
+template<typename Library, typename T>
+std::vector<scenario<Library, T>> scenarios()
+{
+	using shared = typename Library::template shared<T>;
+	return {
+		{"make_shared", &empty<Library, T>, [](state<Library, T>& s) { s.shared_ = Library::template make<T>(); }},
+		{"construct from new", &empty<Library, T>, [](state<Library, T>& s) { s.shared_ = shared(new T()); }},
+		{"copy", &unique<Library, T>, [](state<Library, T>& s) { s.copy_ = s.shared_; }},
+		{"move", &unique<Library, T>, [](state<Library, T>& s) { s.copy_ = std::move(s.shared_); }},
+		{"destroy, not last", &copied<Library, T>, [](state<Library, T>& s) { s.copy_.reset(); }},
+		{"destroy last", &unique<Library, T>, [](state<Library, T>& s) { s.shared_.reset(); }},
+		{"weak_ptr::lock", &observed<Library, T>, [](state<Library, T>& s) { s.copy_ = s.weak_->lock(); }},
+		{"weak_ptr::expired", &observed<Library, T>, [](state<Library, T>& s) { s.sink_ = s.weak_->expired(); }},
+		{"use_count", &unique<Library, T>, [](state<Library, T>& s) { s.sink_ = s.shared_.use_count(); }},
+	};
+}
+
+constexpr int batch = 100'000;
+constexpr int rounds = 5;
+
+struct result
+{
+	double nanoseconds_;
+	std::optional<bench::hardware_counters::values> counters_;
+};
+
+template<typename Library, typename T>
+result measure(const scenario<Library, T>& measured, bench::hardware_counters& counters)
+{
+	result best{0.0, {}};
+	for (int round = 0; round < rounds; ++round)
+	{
+		std::vector<state<Library, T>> states(batch);
+		for (auto& s : states)
+		{
+			measured.setup_(s);
+		}
+		counters.start();
+		const auto begin = bench::clock::now();
+		for (auto& s : states)
+		{
+			measured.operation_(s);
+		}
+		const auto end = bench::clock::now();
+		const auto values = counters.stop();
+		const double nanoseconds = std::chrono::duration<double, std::nano>(end - begin).count() / batch;
+		if (round == 0 || nanoseconds < best.nanoseconds_)
+		{
+			best = {nanoseconds, counters.available() ? std::optional(values) : std::nullopt};
+		}
+		for (auto& s : states)
+		{
+			bench::do_not_optimize(s.sink_);
+		}
+	}
+	return best;
+}
+
+template<typename T>
+long atomic_ops_of(const int index)
+{
+	using library = smart_library<smart_ptr::basic_atomic_counting<bench::counted_atomic>>;
+	const auto counted = scenarios<library, T>()[index];
+	state<library, T> s;
+	counted.setup_(s);
+	const bench::atomic_ops before = bench::counted_ops;
+	counted.operation_(s);
+	const bench::atomic_ops after = bench::counted_ops;
+	return (after.loads_ - before.loads_) + (after.stores_ - before.stores_) + (after.rmws_ - before.rmws_);
+}
+
+bool first_json = true;
+
+void print(const bool json, const char* library, const char* operation, const std::size_t bytes, const result& measured, const std::optional<long> atomic_ops)
+{
+	const auto per_op = [&](const std::uint64_t total) { return static_cast<double>(total) / batch; };
+	if (json)
+	{
+		std::printf("%s\n\t\t{\"library\": \"%s\", \"operation\": \"%s\", \"payload_bytes\": %zu, \"ns_per_op\": %.3f", first_json ? "" : ",", library, operation, bytes, measured.nanoseconds_);
+		first_json = false;
+		if (measured.counters_)
+		{
+			std::printf(", \"cycles_per_op\": %.2f, \"instructions_per_op\": %.2f, \"cache_misses_per_op\": %.4f",
+				per_op(measured.counters_->cycles_), per_op(measured.counters_->instructions_), per_op(measured.counters_->cache_misses_));
+		}
+		else
+		{
+			std::printf(", \"cycles_per_op\": null, \"instructions_per_op\": null, \"cache_misses_per_op\": null");
+		}
+		if (atomic_ops)
+		{
+			std::printf(", \"atomic_ops_per_op\": %ld}", *atomic_ops);
+		}
+		else
+		{
+			std::printf(", \"atomic_ops_per_op\": null}");
+		}
+		return;
+	}
+	std::printf("%-10s %-20s %6zu %8.2f", library, operation, bytes, measured.nanoseconds_);
+	if (measured.counters_)
+	{
+		std::printf(" %8.1f %8.1f %8.3f", per_op(measured.counters_->cycles_), per_op(measured.counters_->instructions_), per_op(measured.counters_->cache_misses_));
+	}
+	else
+	{
+		std::printf(" %8s %8s %8s", "-", "-", "-");
+	}
+	if (atomic_ops)
+	{
+		std::printf(" %6ld\n", *atomic_ops);
+	}
+	else
+	{
+		std::printf(" %6s\n", "-");
+	}
+}
+
+template<std::size_t Size>
+void payload_rows(const bool json, bench::hardware_counters& counters)
+{
+	using T = payload<Size>;
+	const auto smart = scenarios<smart_library<smart_ptr::atomic_counting>, T>();
+	const auto standard = scenarios<std_library, T>();
+	for (int i = 0; i < static_cast<int>(smart.size()); ++i)
+	{
+		print(json, smart_library<smart_ptr::atomic_counting>::name, smart[i].name_, Size, measure(smart[i], counters), atomic_ops_of<T>(i));
+		print(json, std_library::name, standard[i].name_, Size, measure(standard[i], counters), std::nullopt);
+	}
+}
+
+}
+
+int main(const int argc, char* argv[])
+{
+	const bool json = argc > 1 && std::strcmp(argv[1], "--json") == 0;
+	// libstdc++ counts without atomic instructions until the process starts a thread. Compare multi-threaded builds.
+	std::thread([] {}).join();
+	bench::hardware_counters counters;
+	if (json)
+	{
+		std::printf("{\n\t\"benchmark\": \"shared_ptr_bench\",\n\t\"batch\": %d,\n\t\"hardware_counters\": %s,\n\t\"results\": [", batch, counters.available() ? "true" : "false");
+	}
+	else
+	{
+		std::printf("# ns and hardware counters per operation, one thread, best of %d batches of %d%s\n", rounds, batch, counters.available() ? "" : " (perf_event_open not permitted, no counters)");
+		std::printf("%-10s %-20s %6s %8s %8s %8s %8s %6s\n", "library", "operation", "bytes", "ns", "cycles", "instr", "misses", "atomic");
+	}
+	payload_rows<8>(json, counters);
+	payload_rows<64>(json, counters);
+	payload_rows<512>(json, counters);
+	if (json)
+	{
+		std::printf("\n\t]\n}\n");
+	}
+	return 0;
+}
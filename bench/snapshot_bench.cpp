@@ -0,0 +1,125 @@
+#include "bench.h"
+#include "snapshot.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+/// Read-mostly table: thread 0 publishes a modified copy every writer_pause reads, the other threads look up entries.
+/// Compares the std::mutex guarded shared_ptr the routing table used with snapshot<T>::read().
+///
+/// Usage: snapshot_bench [max_threads]
+
+namespace
+{
+
+struct table
+{
+	std::vector<int> next_hop_ = std::vector<int>(256, 1);
+};
+
+constexpr int reads_per_thread = 2'000'000;
+constexpr int writer_pause = 10'000;
+
+class mutex_table
+{
+	mutable std::mutex mutex_;
+	smart_ptr::shared_ptr<table> current_{smart_ptr::make_shared<table>()};
+
+public:
+	[[nodiscard]] int lookup(const int key) const
+	{
+		smart_ptr::shared_ptr<table> version;
+		{
+			const std::lock_guard lock(mutex_);
+			version = current_;
+		}
+		return version->next_hop_[key];
+	}
+
+	void modify(const int key)
+	{
+		auto next = smart_ptr::make_shared<table>(*current_);
+		++next->next_hop_[key];
+		const std::lock_guard lock(mutex_);
+		current_ = std::move(next);
+	}
+};
+
+class snapshot_table
+{
+	smart_ptr::snapshot<table> current_{smart_ptr::make_shared<table>()};
+
+public:
+	[[nodiscard]] int lookup(const int key) const
+	{
+		return current_.read()->next_hop_[key];
+	}
+
+	void modify(const int key)
+	{
+		current_.update([key](table& next) { ++next.next_hop_[key]; });
+	}
+};
+
+template<typename Table>
+double reads_per_second(const int threads)
+{
+	Table subject;
+	std::atomic<int> readers_left{threads - 1};
+	const double seconds = bench::run_threads(threads, [&](const int index)
+	{
+		if (index == 0 && threads > 1)
+		{
+			for (int key = 0; readers_left != 0; key = (key + 1) % 256)
+			{
+				subject.modify(key);
+				for (int i = 0; i < writer_pause && readers_left != 0; ++i)
+				{
+					bench::do_not_optimize(subject.lookup(key));
+				}
+			}
+			return;
+		}
+		long sum = 0;
+		for (int i = 0; i < reads_per_thread; ++i)
+		{
+			sum += subject.lookup(i % 256);
+		}
+		bench::do_not_optimize(sum);
+		--readers_left;
+	});
+	const int readers = threads > 1 ? threads - 1 : 1;
+	return static_cast<double>(readers) * reads_per_thread / seconds;
+}
+
+template<typename Table>
+void row(const char* name, const std::vector<int>& counts)
+{
+	std::printf("%-16s", name);
+	for (const int n : counts)
+	{
+		std::printf(" %8.2f", reads_per_second<Table>(n) / 1e6);
+	}
+	std::printf("\n");
+	smart_ptr::epoch_clean_up();
+}
+
+}
+
+int main(const int argc, char* argv[])
+{
+	const int max_threads = argc > 1 ? std::atoi(argv[1]) : 16;
+	const auto counts = bench::thread_counts(max_threads);
+
+	std::printf("# lookups per second (millions), one writer thread among the threads (except with 1 thread)\n%-16s", "table \\ threads");
+	for (const int n : counts)
+	{
+		std::printf(" %8d", n);
+	}
+	std::printf("\n");
+	row<mutex_table>("std::mutex", counts);
+	row<snapshot_table>("snapshot", counts);
+	return 0;
+}
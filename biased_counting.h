@@ -0,0 +1,345 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+#include "shared_ptr.h"
+
+/// Biased reference counting (Choi, Shull, Torrellas: Biased Reference Counting, PACT 2018) as a counting policy.
+///
+///	- Control block remembers the thread which created it (owner). Owner counts its references in biased_
+///	  by plain loads and stores. No lock prefix, copy and destruction cost about the same as for a raw pointer.
+///	- Other threads count theirs in shared_ by atomic RMW. shared_ goes negative when a reference counted
+///	  in biased_ is handed to another thread and released there.
+///	- Merge adds biased_ to shared_ and marks the block merged. From then on every thread uses shared_ only.
+///	  Owner merges when biased_ drops to zero.
+///	- Thread which makes shared_ negative for the first time puts the block into a queue of the owner.
+///	  Owner merges queued blocks in biased_merge_queued(), when it creates a biased block and when it finishes.
+///	  Last reference of a queued block may be gone earlier. Its payload is destroyed by the merge.
+///	- Block queued to a finished thread is merged right away by the thread which queued it.
+///
+/// Notes:
+///	- weak_ptr::lock fails when strong count is zero. Other thread than owner reads biased_ possibly stale,
+///	  so it can still lock an object waiting for the merge. That is safe: the merge counts that reference too.
+///	- use_count() called by other thread than owner is approximate.
+///	- Control block is 32 bytes of counters instead of 8.
+///	- Each thread which has created a biased block has a small record. It is freed when the thread has finished
+///	  and no block is biased to it any more.
+///
+namespace smart_ptr
+{
+
+struct biased_counting;
+
+namespace detail
+{
+
+/// Thread which created biased blocks. Kept alive by its thread and by every block biased to it.
+class brc_owner
+{
+	/// Queued blocks, linked by biased_counting::queue_next_. closed_() once the thread has finished.
+	std::atomic<biased_counting*> queue_{nullptr};
+	std::atomic<long> references_{1};
+
+	struct thread_state
+	{
+		brc_owner* owner_{new brc_owner};
+
+		~thread_state()
+		{
+			current_ = nullptr;
+			finished_ = true;
+			owner_->merge_(owner_->queue_.exchange(closed_(), std::memory_order_acq_rel));
+			owner_->release();
+		}
+	};
+
+	static inline thread_local brc_owner* current_{nullptr};
+	static inline thread_local bool finished_{false};
+
+	static biased_counting* closed_() noexcept
+	{
+		return reinterpret_cast<biased_counting*>(std::uintptr_t{1});
+	}
+
+	static void merge_(biased_counting* queued) noexcept;
+
+public:
+	/// Owner for blocks created by this thread. nullptr once the thread is finishing.
+	static brc_owner* current()
+	{
+		if (!current_ && !finished_)
+		{
+			thread_local thread_state state;
+			current_ = state.owner_;
+		}
+		return current_;
+	}
+
+	/// Faster than current(). nullptr before the first biased block of this thread.
+	static brc_owner* current_if_any() noexcept
+	{
+		return current_;
+	}
+
+	void add_reference() noexcept
+	{
+		references_.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void release() noexcept
+	{
+		if (references_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			delete this;
+		}
+	}
+
+	[[nodiscard]] bool has_queued() const noexcept
+	{
+		return queue_.load(std::memory_order_relaxed) != nullptr;
+	}
+
+	/// Called by the owner thread only.
+	void merge_queued() noexcept
+	{
+		merge_(queue_.exchange(nullptr, std::memory_order_acquire));
+	}
+
+	/// Owner thread has finished: caller merges the block itself.
+	void enqueue(biased_counting* counting) noexcept;
+};
+
+}
+
+struct biased_counting
+{
+	/// count << flag_bits | flags
+	static constexpr int flag_bits = 2;
+	static constexpr std::int64_t merged = 1;
+	static constexpr std::int64_t queued = 2;
+	static constexpr std::int64_t one = std::int64_t{1} << flag_bits;
+
+	detail::brc_owner* const owner_;
+	/// Written by the owner thread only. Atomic just so other threads may read it.
+	std::atomic<int> biased_{1};
+	std::atomic<int> weak_usages_{1};
+	std::atomic<std::int64_t> shared_{0};
+	biased_counting* queue_next_{nullptr};
+
+	biased_counting();
+	~biased_counting();
+	biased_counting(const biased_counting&) = delete;
+	biased_counting& operator=(const biased_counting&) = delete;
+
+	static std::int64_t count_of(const std::int64_t shared) noexcept
+	{
+		return shared >> flag_bits;
+	}
+
+	/// Owner thread before the merge.
+	[[nodiscard]] bool is_biased_here() const noexcept
+	{
+		return owner_ == detail::brc_owner::current_if_any() && biased_.load(std::memory_order_relaxed) > 0;
+	}
+
+	void add_strong() noexcept
+	{
+		if (is_biased_here())
+		{
+			biased_.store(biased_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			return;
+		}
+		shared_.fetch_add(one, std::memory_order_relaxed);
+	}
+
+	bool try_add_strong() noexcept
+	{
+		if (is_biased_here())
+		{
+			const int biased = biased_.load(std::memory_order_relaxed);
+			if (biased + count_of(shared_.load(std::memory_order_acquire)) <= 0)
+			{
+				// Released by other threads, waiting for the merge.
+				return false;
+			}
+			biased_.store(biased + 1, std::memory_order_relaxed);
+			return true;
+		}
+		std::int64_t expected = shared_.load(std::memory_order_relaxed);
+		do
+		{
+			if (count_of_snapshot_(expected) <= 0)
+			{
+				return false;
+			}
+		} while (!shared_.compare_exchange_weak(expected, expected + one, std::memory_order_acquire, std::memory_order_relaxed));
+		return true;
+	}
+
+	bool release_strong() noexcept
+	{
+		if (is_biased_here())
+		{
+			const int biased = biased_.load(std::memory_order_relaxed) - 1;
+			biased_.store(biased, std::memory_order_relaxed);
+			if (biased > 0)
+			{
+				return false;
+			}
+			// Implicit merge. Queued block is finished by the merge of the queue, it is still linked there.
+			const std::int64_t old = shared_.fetch_or(merged, std::memory_order_acq_rel);
+			return count_of(old) == 0 && !(old & queued);
+		}
+		std::int64_t expected = shared_.load(std::memory_order_relaxed);
+		std::int64_t desired;
+		do
+		{
+			desired = expected - one;
+			if (!(desired & merged) && count_of(desired) < 0)
+			{
+				desired |= queued;
+			}
+		} while (!shared_.compare_exchange_weak(expected, desired, std::memory_order_acq_rel, std::memory_order_relaxed));
+		if ((desired & queued) && !(expected & queued))
+		{
+			owner_->enqueue(this);
+			return false;
+		}
+		return (desired & merged) && !(desired & queued) && count_of(desired) == 0;
+	}
+
+	void add_weak() noexcept
+	{
+		weak_usages_.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	bool release_weak() noexcept
+	{
+		return weak_usages_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+	}
+
+	[[nodiscard]] long use_count() const noexcept
+	{
+		std::int64_t shared = shared_.load(std::memory_order_relaxed);
+		return static_cast<long>(count_of_snapshot_(shared));
+	}
+
+	/// Strong count from shared_ and biased_ read consistently. shared is the last value of shared_ seen, updated.
+	/// Merge adds biased_ to shared_ before clearing biased_. So when shared_ did not change while biased_ was read,
+	/// both belong together: a merge between the reads would have set the merged flag.
+	std::int64_t count_of_snapshot_(std::int64_t& shared) const noexcept
+	{
+		for (;;)
+		{
+			if (shared & merged)
+			{
+				return count_of(shared);
+			}
+			// Acquire: biased_ cleared by a merge makes the merged shared_ visible to the second load.
+			const int biased = biased_.load(std::memory_order_acquire);
+			const std::int64_t again = shared_.load(std::memory_order_acquire);
+			if (again == shared)
+			{
+				return count_of(shared) + biased;
+			}
+			shared = again;
+		}
+	}
+
+	/// Explicit merge of a queued block. Called by the owner, or by the thread which queued it when the owner has finished.
+	void merge_queued() noexcept
+	{
+		// biased_ is cleared after shared_ is merged. Otherwise try_add_strong of another thread could see neither.
+		const int biased = biased_.load(std::memory_order_relaxed);
+		std::int64_t expected = shared_.load(std::memory_order_relaxed);
+		std::int64_t desired;
+		do
+		{
+			desired = ((expected + biased * one) | merged) & ~queued;
+		} while (!shared_.compare_exchange_weak(expected, desired, std::memory_order_acq_rel, std::memory_order_relaxed));
+		biased_.store(0, std::memory_order_release);
+		if (count_of(desired) == 0)
+		{
+			detail::finish_strong(static_cast<detail::control_block<biased_counting>*>(this));
+		}
+	}
+};
+
+template<typename T>
+using biased_shared_ptr = shared_ptr<T, biased_counting>;
+
+template<typename T>
+using biased_weak_ptr = weak_ptr<T, biased_counting>;
+
+template<typename T, typename... Args>
+biased_shared_ptr<T> make_biased_shared(Args&&... args)
+{
+	return make_shared<T, biased_counting>(std::forward<Args>(args)...);
+}
+
+/// Merges blocks created by this thread whose count went negative in other threads.
+/// Destroys those nobody references any more. Also done when this thread creates a biased block and when it finishes.
+inline void biased_merge_queued() noexcept
+{
+	if (detail::brc_owner* owner = detail::brc_owner::current_if_any())
+	{
+		owner->merge_queued();
+	}
+}
+
+inline biased_counting::biased_counting()
+	: owner_(detail::brc_owner::current())
+{
+	if (!owner_)
+	{
+		// Created while the thread is finishing. Nobody would merge it, so it starts merged.
+		biased_.store(0, std::memory_order_relaxed);
+		shared_.store(one | merged, std::memory_order_relaxed);
+		return;
+	}
+	owner_->add_reference();
+	if (owner_->has_queued())
+	{
+		owner_->merge_queued();
+	}
+}
+
+inline biased_counting::~biased_counting()
+{
+	if (owner_)
+	{
+		owner_->release();
+	}
+}
+
+namespace detail
+{
+
+inline void brc_owner::merge_(biased_counting* queued) noexcept
+{
+	while (queued && queued != closed_())
+	{
+		// Merge may free the block.
+		biased_counting* next = queued->queue_next_;
+		queued->merge_queued();
+		queued = next;
+	}
+}
+
+inline void brc_owner::enqueue(biased_counting* counting) noexcept
+{
+	biased_counting* head = queue_.load(std::memory_order_acquire);
+	do
+	{
+		if (head == closed_())
+		{
+			counting->merge_queued();
+			return;
+		}
+		counting->queue_next_ = head;
+	} while (!queue_.compare_exchange_weak(head, counting, std::memory_order_release, std::memory_order_acquire));
+}
+
+}
+
+}
@@ -0,0 +1,146 @@
+#include "catch.hpp"
+#include "alive_counter.h"
+#include "biased_counting.h"
+
+#include <thread>
+#include <vector>
+
+namespace
+{
+struct owned : alive_counter<owned>
+{
+	int value_;
+
+	explicit owned(const int value)
+		: value_(value)
+	{
+	}
+};
+}
+
+TEST_CASE("biased_shared_ptr on the owner thread")
+{
+	SECTION("copies are counted in the biased counter")
+	{
+		auto first = smart_ptr::make_biased_shared<owned>(1);
+		{
+			const auto second = first;
+			REQUIRE(first.use_count() == 2);
+			REQUIRE(first->value_ == 1);
+		}
+		REQUIRE(first.use_count() == 1);
+		first = smart_ptr::biased_shared_ptr<owned>{};
+		REQUIRE(owned::alive_ == 0);
+	}
+
+	SECTION("weak_ptr")
+	{
+		auto shared = smart_ptr::make_biased_shared<owned>(2);
+		smart_ptr::biased_weak_ptr<owned> weak(shared);
+		REQUIRE(!weak.expired());
+		REQUIRE(weak.lock()->value_ == 2);
+		REQUIRE(shared.use_count() == 1);
+		shared = smart_ptr::biased_shared_ptr<owned>{};
+		REQUIRE(weak.expired());
+		REQUIRE(!weak.lock());
+		REQUIRE(owned::alive_ == 0);
+	}
+
+	SECTION("separately allocated payload")
+	{
+		smart_ptr::biased_shared_ptr<owned> shared(new owned(3));
+		auto copy = shared;
+		REQUIRE(shared.use_count() == 2);
+	}
+	REQUIRE(owned::alive_ == 0);
+}
+
+TEST_CASE("biased_shared_ptr released by other threads")
+{
+	SECTION("last reference released by other thread waits for the merge")
+	{
+		auto shared = smart_ptr::make_biased_shared<owned>(4);
+		smart_ptr::biased_weak_ptr<owned> weak(shared);
+		std::thread([copy = shared]() mutable
+		{
+			copy = smart_ptr::biased_shared_ptr<owned>{};
+		}).join();
+		shared = smart_ptr::biased_shared_ptr<owned>{};
+		// Biased counter still counts the reference released by the other thread.
+		REQUIRE(owned::alive_ == 1);
+		REQUIRE(weak.expired());
+		REQUIRE(!weak.lock());
+		smart_ptr::biased_merge_queued();
+		REQUIRE(owned::alive_ == 0);
+	}
+
+	SECTION("owner releases last after the other thread")
+	{
+		auto shared = smart_ptr::make_biased_shared<owned>(5);
+		int seen = 0;
+		std::thread([copy = shared, &seen]() mutable
+		{
+			seen = copy->value_;
+			copy = smart_ptr::biased_shared_ptr<owned>{};
+		}).join();
+		REQUIRE(seen == 5);
+		smart_ptr::biased_merge_queued();
+		REQUIRE(shared.use_count() == 1);
+		REQUIRE(owned::alive_ == 1);
+		shared = smart_ptr::biased_shared_ptr<owned>{};
+		REQUIRE(owned::alive_ == 0);
+	}
+
+	SECTION("owner thread has finished")
+	{
+		smart_ptr::biased_shared_ptr<owned> shared;
+		std::thread([&shared]
+		{
+			shared = smart_ptr::make_biased_shared<owned>(6);
+		}).join();
+		REQUIRE(shared->value_ == 6);
+		smart_ptr::biased_weak_ptr<owned> weak(shared);
+		REQUIRE(weak.lock()->value_ == 6);
+		shared = smart_ptr::biased_shared_ptr<owned>{};
+		REQUIRE(owned::alive_ == 0);
+		REQUIRE(weak.expired());
+	}
+
+	SECTION("copies racing on many threads")
+	{
+		constexpr int iterations = 20'000;
+		auto shared = smart_ptr::make_biased_shared<owned>(7);
+		smart_ptr::biased_weak_ptr<owned> weak(shared);
+		std::atomic<bool> lock_failed{false};
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 3; ++t)
+		{
+			threads.emplace_back([copy = shared, &weak, &lock_failed]
+			{
+				for (int i = 0; i < iterations; ++i)
+				{
+					const auto again = copy;
+					if (!smart_ptr::biased_weak_ptr<owned>(weak).lock())
+					{
+						lock_failed = true;
+					}
+				}
+			});
+		}
+		for (int i = 0; i < iterations; ++i)
+		{
+			const auto again = shared;
+			smart_ptr::biased_merge_queued();
+		}
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+		smart_ptr::biased_merge_queued();
+		REQUIRE(!lock_failed);
+		REQUIRE(shared.use_count() == 1);
+		REQUIRE(owned::alive_ == 1);
+		shared = smart_ptr::biased_shared_ptr<owned>{};
+		REQUIRE(owned::alive_ == 0);
+	}
+}
@@ -0,0 +1,308 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+/// Slab pool for control blocks. Opt in per object:
+///	- allocate_shared<T>(smart_ptr::pool_allocator<T>{}, args...) puts control block and T into one pooled block.
+///	- shared_ptr<T>(ptr, std::default_delete<T>{}, smart_ptr::pool_allocator<T>{}) pools only the control block.
+///
+/// How it works:
+///	- Every thread has its own heap per block size. Allocation and free on the same thread are plain pointer pushes and pops.
+///	- Block freed by other thread is collected in a small per-thread batch. Whole batch is returned to the owning heap by one CAS.
+///	- Owner takes all returned blocks at once (one exchange) when its own free list is empty.
+///	- Owner of a block is found in the header of the slab. Slabs are aligned to their size.
+///	- Heap of a finished thread is adopted by the next thread. Slabs are never returned to the system.
+///	- pool_allocator<T, true> uses 2 MB slabs advised as transparent huge pages (Linux only, elsewhere just 2 MB slabs).
+///
+namespace smart_ptr
+{
+namespace detail
+{
+
+template<std::size_t BlockSize, bool HugePages>
+class slab_heap
+{
+	struct free_block
+	{
+		free_block* next_;
+	};
+
+	struct alignas(std::max_align_t) slab_header
+	{
+		slab_heap* owner_;
+	};
+
+	static constexpr std::size_t slab_size = HugePages ? std::size_t{2} << 20 : std::size_t{64} << 10;
+	static constexpr std::size_t block_size = (BlockSize + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+	static constexpr std::size_t blocks_per_slab = (slab_size - sizeof(slab_header)) / block_size;
+	/// Blocks freed by other thread are kept locally until this many are ready to be returned at once.
+	static constexpr int batch_limit = 32;
+	static_assert(block_size >= sizeof(free_block));
+	static_assert(blocks_per_slab >= 1);
+
+	/// Touched only by the thread which currently owns the heap.
+	free_block* local_free_{nullptr};
+	char* bump_{nullptr};
+	char* bump_end_{nullptr};
+	/// Blocks returned by other threads.
+	std::atomic<free_block*> returned_{nullptr};
+
+	struct registry
+	{
+		std::mutex mutex_;
+		std::vector<slab_heap*> abandoned_;
+	};
+
+	/// Never destroyed. Threads may still free blocks while static objects are being destroyed.
+	static registry& registry_()
+	{
+		static auto* instance = new registry;
+		return *instance;
+	}
+
+	static slab_heap* acquire_()
+	{
+		auto& reg = registry_();
+		{
+			std::lock_guard lock(reg.mutex_);
+			if (!reg.abandoned_.empty())
+			{
+				slab_heap* heap = reg.abandoned_.back();
+				reg.abandoned_.pop_back();
+				return heap;
+			}
+		}
+		return new slab_heap;
+	}
+
+	static void release_(slab_heap* heap)
+	{
+		auto& reg = registry_();
+		std::lock_guard lock(reg.mutex_);
+		reg.abandoned_.push_back(heap);
+	}
+
+	struct thread_state
+	{
+		slab_heap* heap_{acquire_()};
+		slab_heap* batch_owner_{nullptr};
+		free_block* batch_head_{nullptr};
+		free_block* batch_tail_{nullptr};
+		int batch_size_{0};
+
+		~thread_state()
+		{
+			flush();
+			release_(heap_);
+			finished_ = true;
+		}
+
+		void flush() noexcept
+		{
+			if (batch_owner_)
+			{
+				batch_owner_->give_back_(batch_head_, batch_tail_);
+				batch_owner_ = nullptr;
+				batch_head_ = batch_tail_ = nullptr;
+				batch_size_ = 0;
+			}
+		}
+
+		void defer_give_back(slab_heap* owner, free_block* block) noexcept
+		{
+			if (owner != batch_owner_)
+			{
+				flush();
+				batch_owner_ = owner;
+				batch_tail_ = block;
+			}
+			block->next_ = batch_head_;
+			batch_head_ = block;
+			if (++batch_size_ == batch_limit)
+			{
+				flush();
+			}
+		}
+	};
+
+	/// Set after thread_state of this thread is destroyed. (Other thread_local destructors may still free blocks.)
+	static inline thread_local bool finished_{false};
+
+	static thread_state& local_()
+	{
+		thread_local thread_state state;
+		return state;
+	}
+
+	static slab_header* header_of_(void* block) noexcept
+	{
+		return reinterpret_cast<slab_header*>(reinterpret_cast<std::uintptr_t>(block) & ~(slab_size - 1));
+	}
+
+	void give_back_(free_block* head, free_block* tail) noexcept
+	{
+		tail->next_ = returned_.load(std::memory_order_relaxed);
+		while (!returned_.compare_exchange_weak(tail->next_, head, std::memory_order_release, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	/// Slab aligned to its size, so the header is found by masking block address.
+	static void* map_slab_()
+	{
+#if defined(__linux__)
+		// Map twice the size and unmap the misaligned ends. Slabs do not go through malloc at all.
+		void* raw = ::mmap(nullptr, 2 * slab_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (raw == MAP_FAILED)
+		{
+			throw std::bad_alloc{};
+		}
+		const auto begin = reinterpret_cast<std::uintptr_t>(raw);
+		const auto aligned = (begin + slab_size - 1) & ~(slab_size - 1);
+		if (aligned != begin)
+		{
+			::munmap(raw, aligned - begin);
+		}
+		::munmap(reinterpret_cast<void*>(aligned + slab_size), begin + slab_size - aligned);
+#if defined(MADV_HUGEPAGE)
+		if constexpr (HugePages)
+		{
+			::madvise(reinterpret_cast<void*>(aligned), slab_size, MADV_HUGEPAGE);
+		}
+#endif
+		return reinterpret_cast<void*>(aligned);
+#else
+		return ::operator new(slab_size, std::align_val_t{slab_size});
+#endif
+	}
+
+	void new_slab_()
+	{
+		auto* header = ::new(map_slab_()) slab_header{this};
+		bump_ = reinterpret_cast<char*>(header + 1);
+		bump_end_ = bump_ + blocks_per_slab * block_size;
+	}
+
+	void* pop_()
+	{
+		if (!local_free_ && returned_.load(std::memory_order_relaxed))
+		{
+			local_free_ = returned_.exchange(nullptr, std::memory_order_acquire);
+		}
+		if (local_free_)
+		{
+			free_block* block = local_free_;
+			local_free_ = block->next_;
+			return block;
+		}
+		if (bump_ == bump_end_)
+		{
+			new_slab_();
+		}
+		void* block = bump_;
+		bump_ += block_size;
+		return block;
+	}
+
+public:
+	static void* allocate()
+	{
+		if (finished_)
+		{
+			// Thread is being torn down. Borrow any heap for this one allocation.
+			slab_heap* heap = acquire_();
+			void* block = heap->pop_();
+			release_(heap);
+			return block;
+		}
+		return local_().heap_->pop_();
+	}
+
+	static void deallocate(void* ptr) noexcept
+	{
+		auto* block = static_cast<free_block*>(ptr);
+		slab_heap* owner = header_of_(ptr)->owner_;
+		if (finished_)
+		{
+			owner->give_back_(block, block);
+			return;
+		}
+		thread_state& state = local_();
+		if (owner == state.heap_)
+		{
+			block->next_ = owner->local_free_;
+			owner->local_free_ = block;
+			return;
+		}
+		state.defer_give_back(owner, block);
+	}
+};
+
+}
+
+/// Stateless allocator backed by per-thread slabs. Objects bigger than max_pooled_size go to operator new.
+template<typename T, bool HugePages = false>
+class pool_allocator
+{
+	using heap = detail::slab_heap<sizeof(T), HugePages>;
+
+public:
+	using value_type = T;
+
+	static constexpr std::size_t max_pooled_size = 256;
+	static constexpr bool pooled = sizeof(T) <= max_pooled_size && alignof(T) <= alignof(std::max_align_t);
+
+	template<typename U>
+	struct rebind
+	{
+		using other = pool_allocator<U, HugePages>;
+	};
+
+	constexpr pool_allocator() noexcept = default;
+
+	template<typename U>
+	constexpr pool_allocator(const pool_allocator<U, HugePages>&) noexcept
+	{
+	}
+
+	[[nodiscard]] T* allocate(const std::size_t n)
+	{
+		if constexpr (pooled)
+		{
+			if (n == 1)
+			{
+				return static_cast<T*>(heap::allocate());
+			}
+		}
+		return std::allocator<T>{}.allocate(n);
+	}
+
+	void deallocate(T* ptr, const std::size_t n) noexcept
+	{
+		if constexpr (pooled)
+		{
+			if (n == 1)
+			{
+				heap::deallocate(ptr);
+				return;
+			}
+		}
+		std::allocator<T>{}.deallocate(ptr, n);
+	}
+
+	template<typename U>
+	friend constexpr bool operator==(const pool_allocator&, const pool_allocator<U, HugePages>&) noexcept
+	{
+		return true;
+	}
+};
+
+}
@@ -0,0 +1,85 @@
+#include "catch.hpp"
+#include "control_block_pool.h"
+#include "shared_ptr.h"
+
+#include <thread>
+#include <vector>
+
+namespace
+{
+struct message
+{
+	int id_;
+	char body_[40]{};
+
+	explicit message(const int id)
+		: id_(id)
+	{
+	}
+};
+}
+
+TEST_CASE("Pooled allocate_shared")
+{
+	SECTION("Freed block is reused by the same thread")
+	{
+		const message* first{};
+		{
+			const auto shared = smart_ptr::allocate_shared<message>(smart_ptr::pool_allocator<message>{}, 1);
+			REQUIRE(shared->id_ == 1);
+			first = shared.get();
+		}
+		const auto shared = smart_ptr::allocate_shared<message>(smart_ptr::pool_allocator<message>{}, 2);
+		REQUIRE(shared->id_ == 2);
+		REQUIRE(shared.get() == first);
+	}
+
+	SECTION("Weak pointer keeps pooled block")
+	{
+		auto shared = smart_ptr::allocate_shared<message>(smart_ptr::pool_allocator<message>{}, 3);
+		const smart_ptr::weak_ptr<message> weak(shared);
+		shared = smart_ptr::shared_ptr<message>{};
+		REQUIRE(weak.expired());
+	}
+
+	SECTION("Huge page slabs")
+	{
+		const auto shared = smart_ptr::allocate_shared<message>(smart_ptr::pool_allocator<message, true>{}, 4);
+		REQUIRE(shared->id_ == 4);
+	}
+}
+
+TEST_CASE("Pooled separate control block")
+{
+	auto* payload = new message(5);
+	const smart_ptr::shared_ptr<message> shared(payload, std::default_delete<message>{}, smart_ptr::pool_allocator<message>{});
+	REQUIRE(shared.get() == payload);
+	REQUIRE(shared.use_count() == 1);
+}
+
+TEST_CASE("Pooled blocks freed by other thread")
+{
+	constexpr int count = 1000;
+	std::vector<smart_ptr::shared_ptr<message>> created;
+	std::thread producer([&created]
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			created.push_back(smart_ptr::allocate_shared<message>(smart_ptr::pool_allocator<message>{}, i));
+		}
+	});
+	producer.join();
+	REQUIRE(created.size() == count);
+	REQUIRE(created.back()->id_ == count - 1);
+	created.clear();
+
+	// Heap of the finished producer is adopted by the next thread together with the returned blocks.
+	std::thread consumer([]
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			const auto shared = smart_ptr::allocate_shared<message>(smart_ptr::pool_allocator<message>{}, i);
+		}
+	});
+	consumer.join();
+}
@@ -0,0 +1,229 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <utility>
+
+#include "shared_ptr.h"
+
+/// Counting policy with deferred decrements: releasing a strong reference appends the control block to a buffer
+/// of the calling thread. The buffer subtracts in batches, one fetch_sub(n) per control block.
+///
+///	- Buffer is flushed when full (256 control blocks), by deferred_flush() and when its thread finishes.
+///	  Payloads are destroyed only by a flush, on the flushing thread.
+///	- Consecutive releases of the same block are combined on append, the rest when flushing (sorted by address).
+///	- Release takes effect at the flush. Until then the reference counts as alive for everybody, the releasing
+///	  thread included: use_count() counts it, expired() is false and weak_ptr::lock succeeds. The object is not
+///	  destroyed yet, so that is safe. A lock which succeeds adds a reference, so the flush does not destroy it.
+///	  Strong count reaches zero only by a flush and never leaves zero: lock is a CAS which fails at zero.
+///	- Call deferred_flush() at quiescent points (end of a request, before waiting) to bound how long objects live.
+///	- Payloads destroyed by a flush may release further references. They are appended to the buffer and flushed
+///	  by the same deferred_flush() call. When the buffer is full during a flush, they are subtracted right away.
+///
+namespace smart_ptr
+{
+
+struct deferred_counting;
+
+namespace detail
+{
+
+/// Strong references released by one thread and not yet subtracted.
+class deferred_buffer
+{
+	struct entry
+	{
+		deferred_counting* counting_;
+		long count_;
+	};
+
+	static constexpr std::size_t capacity = 256;
+
+	entry entries_[capacity];
+	std::size_t size_{0};
+	bool flushing_{false};
+
+	static inline thread_local bool finished_{false};
+
+	deferred_buffer() = default;
+
+	~deferred_buffer()
+	{
+		flush();
+		finished_ = true;
+	}
+
+	/// nullptr once the thread is finishing.
+	static deferred_buffer* current() noexcept
+	{
+		if (finished_)
+		{
+			return nullptr;
+		}
+		thread_local deferred_buffer buffer;
+		return &buffer;
+	}
+
+public:
+	deferred_buffer(const deferred_buffer&) = delete;
+	deferred_buffer& operator=(const deferred_buffer&) = delete;
+
+	static void release(deferred_counting* counting) noexcept;
+
+	/// Subtracts everything released by the calling thread.
+	static void flush_current() noexcept
+	{
+		if (deferred_buffer* buffer = current())
+		{
+			buffer->flush();
+		}
+	}
+
+	[[nodiscard]] static std::size_t pending_current() noexcept
+	{
+		const deferred_buffer* buffer = current();
+		return buffer ? buffer->size_ : 0;
+	}
+
+	void flush() noexcept;
+};
+
+}
+
+struct deferred_counting
+{
+	std::atomic<long> usages_{1};
+	std::atomic<int> weak_usages_{1};
+
+	void add_strong() noexcept
+	{
+		usages_.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	bool try_add_strong() noexcept
+	{
+		long count = usages_.load(std::memory_order_relaxed);
+		do
+		{
+			if (count == 0)
+			{
+				return false;
+			}
+		} while (!usages_.compare_exchange_weak(count, count + 1, std::memory_order_acq_rel, std::memory_order_relaxed));
+		return true;
+	}
+
+	/// Never the last one: the flush destroys the payload.
+	bool release_strong() noexcept
+	{
+		detail::deferred_buffer::release(this);
+		return false;
+	}
+
+	/// Subtracts count references at once. Destroys the payload when they were the last ones.
+	void subtract(const long count) noexcept
+	{
+		if (usages_.fetch_sub(count, std::memory_order_acq_rel) == count)
+		{
+			detail::finish_strong(static_cast<detail::control_block<deferred_counting>*>(this));
+		}
+	}
+
+	void add_weak() noexcept
+	{
+		weak_usages_.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	bool release_weak() noexcept
+	{
+		return weak_usages_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+	}
+
+	/// Counts pending releases.
+	[[nodiscard]] long use_count() const noexcept
+	{
+		return usages_.load(std::memory_order_relaxed);
+	}
+};
+
+template<typename T>
+using deferred_shared_ptr = shared_ptr<T, deferred_counting>;
+
+template<typename T>
+using deferred_weak_ptr = weak_ptr<T, deferred_counting>;
+
+template<typename T, typename... Args>
+deferred_shared_ptr<T> make_deferred_shared(Args&&... args)
+{
+	return make_shared<T, deferred_counting>(std::forward<Args>(args)...);
+}
+
+/// Subtracts all releases of deferred_shared_ptrs by this thread. Destroys the objects nobody references any more.
+inline void deferred_flush() noexcept
+{
+	detail::deferred_buffer::flush_current();
+}
+
+/// Number of control blocks with releases of this thread waiting for the flush.
+[[nodiscard]] inline std::size_t deferred_pending() noexcept
+{
+	return detail::deferred_buffer::pending_current();
+}
+
+namespace detail
+{
+
+inline void deferred_buffer::release(deferred_counting* counting) noexcept
+{
+	deferred_buffer* buffer = current();
+	if (!buffer || (buffer->flushing_ && buffer->size_ == capacity))
+	{
+		counting->subtract(1);
+		return;
+	}
+	if (buffer->size_ != 0 && buffer->entries_[buffer->size_ - 1].counting_ == counting)
+	{
+		++buffer->entries_[buffer->size_ - 1].count_;
+		return;
+	}
+	if (buffer->size_ == capacity)
+	{
+		buffer->flush();
+	}
+	buffer->entries_[buffer->size_++] = {counting, 1};
+}
+
+inline void deferred_buffer::flush() noexcept
+{
+	if (flushing_)
+	{
+		// Appends of the running flush are taken by its loop.
+		return;
+	}
+	flushing_ = true;
+	entry batch[capacity];
+	while (size_ != 0)
+	{
+		// Taken out first: destroyed payloads append to the buffer.
+		const std::size_t size = std::exchange(size_, 0);
+		std::copy(entries_, entries_ + size, batch);
+		std::sort(batch, batch + size, [](const entry& lhs, const entry& rhs) { return std::less<>{}(lhs.counting_, rhs.counting_); });
+		std::size_t i = 0;
+		while (i < size)
+		{
+			deferred_counting* counting = batch[i].counting_;
+			long count = 0;
+			for (; i < size && batch[i].counting_ == counting; ++i)
+			{
+				count += batch[i].count_;
+			}
+			counting->subtract(count);
+		}
+	}
+	flushing_ = false;
+}
+
+}
+
+}
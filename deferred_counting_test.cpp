@@ -0,0 +1,138 @@
+#include "catch.hpp"
+#include "alive_counter.h"
+#include "deferred_counting.h"
+
+#include <thread>
+#include <vector>
+
+namespace
+{
+struct deferred_payload : alive_counter<deferred_payload>
+{
+	int value_;
+	smart_ptr::deferred_shared_ptr<deferred_payload> next_;
+
+	explicit deferred_payload(const int value, smart_ptr::deferred_shared_ptr<deferred_payload> next = {})
+		: value_(value)
+		, next_(std::move(next))
+	{
+	}
+};
+}
+
+TEST_CASE("deferred_shared_ptr")
+{
+	smart_ptr::deferred_flush();
+
+	SECTION("Payload is destroyed by the flush")
+	{
+		auto shared = smart_ptr::make_deferred_shared<deferred_payload>(1);
+		shared.reset();
+		REQUIRE(deferred_payload::alive_ == 1);
+		REQUIRE(smart_ptr::deferred_pending() == 1);
+		smart_ptr::deferred_flush();
+		REQUIRE(deferred_payload::alive_ == 0);
+		REQUIRE(smart_ptr::deferred_pending() == 0);
+	}
+
+	SECTION("Releases of one block are combined")
+	{
+		const auto first = smart_ptr::make_deferred_shared<deferred_payload>(2);
+		const auto second = smart_ptr::make_deferred_shared<deferred_payload>(3);
+		{
+			std::vector<smart_ptr::deferred_shared_ptr<deferred_payload>> copies;
+			for (int i = 0; i < 100; ++i)
+			{
+				copies.push_back(i % 10 < 5 ? first : second);
+			}
+			REQUIRE(first.use_count() == 51);
+		}
+		REQUIRE(smart_ptr::deferred_pending() == 20);
+		REQUIRE(first.use_count() == 51);
+		smart_ptr::deferred_flush();
+		REQUIRE(first.use_count() == 1);
+		REQUIRE(second.use_count() == 1);
+	}
+
+	SECTION("Full buffer is flushed")
+	{
+		std::vector<smart_ptr::deferred_shared_ptr<deferred_payload>> objects;
+		for (int i = 0; i < 1000; ++i)
+		{
+			objects.push_back(smart_ptr::make_deferred_shared<deferred_payload>(i));
+		}
+		objects.clear();
+		REQUIRE(smart_ptr::deferred_pending() < 256);
+		REQUIRE(deferred_payload::alive_ == static_cast<int>(smart_ptr::deferred_pending()));
+		smart_ptr::deferred_flush();
+		REQUIRE(deferred_payload::alive_ == 0);
+	}
+
+	SECTION("Flush destroys what destroyed payloads release")
+	{
+		smart_ptr::deferred_shared_ptr<deferred_payload> list;
+		for (int i = 0; i < 10'000; ++i)
+		{
+			list = smart_ptr::make_deferred_shared<deferred_payload>(i, std::move(list));
+		}
+		list.reset();
+		smart_ptr::deferred_flush();
+		REQUIRE(deferred_payload::alive_ == 0);
+	}
+
+	SECTION("weak_ptr while the release is pending")
+	{
+		auto shared = smart_ptr::make_deferred_shared<deferred_payload>(4);
+		smart_ptr::deferred_weak_ptr<deferred_payload> weak(shared);
+		shared.reset();
+		REQUIRE(!weak.expired());
+		auto locked = weak.lock();
+		REQUIRE(locked->value_ == 4);
+		smart_ptr::deferred_flush();
+		REQUIRE(locked.use_count() == 1);
+		REQUIRE(deferred_payload::alive_ == 1);
+		locked.reset();
+		smart_ptr::deferred_flush();
+		REQUIRE(weak.expired());
+		REQUIRE(!weak.lock());
+	}
+	smart_ptr::deferred_flush();
+	REQUIRE(deferred_payload::alive_ == 0);
+}
+
+TEST_CASE("deferred_shared_ptr released on many threads")
+{
+	constexpr int threads = 8;
+	for (int round = 0; round < 20; ++round)
+	{
+		auto shared = smart_ptr::make_deferred_shared<deferred_payload>(round);
+		smart_ptr::deferred_weak_ptr<deferred_payload> weak(shared);
+		std::atomic<bool> wrong_value{false};
+		std::vector<std::thread> workers;
+		for (int i = 0; i < threads; ++i)
+		{
+			// Releases are pending until each worker finishes, the last finishing one destroys the payload.
+			workers.emplace_back([copy = shared, &weak, &wrong_value, round]() mutable
+			{
+				for (int j = 0; j < 10'000; ++j)
+				{
+					const auto another = j % 2 == 0 ? copy : weak.lock();
+					if (another->value_ != round)
+					{
+						wrong_value = true;
+					}
+				}
+				copy.reset();
+			});
+		}
+		shared.reset();
+		smart_ptr::deferred_flush();
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+		REQUIRE(!wrong_value);
+		REQUIRE(deferred_payload::alive_ == 0);
+		REQUIRE(weak.expired());
+	}
+}
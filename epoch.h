@@ -0,0 +1,252 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "reclamation.h"
+#include "shared_ptr.h"
+
+/// Epoch based reclamation (EBR) for borrowed access to shared objects.
+///
+///	- epoch_guard announces that this thread may hold raw pointers borrowed from shared slots. One store on entry, one on exit.
+///	  Borrowing itself (atomic_shared_ptr::borrow, shared_ptr::get) is a plain load. No atomic RMW on the read path.
+///	- make_epoch_shared<T> creates an object whose destruction waits for readers: when the last strong owner is gone,
+///	  finish_one_instance_ retires the payload instead of destroying it. It is destroyed when every thread inside
+///	  an epoch_guard has moved at least two epochs further. Control block is kept alive until then by one weak reference.
+///	- weak_ptr::lock and expired behave as usual. Object is expired as soon as the strong count drops to zero.
+///
+/// Domain:
+///	- One process wide domain. Per thread records are never freed, they are reused by new threads.
+///	- Every thread keeps its own list of retired objects. Every retire_batch-th retire tries to advance the global epoch.
+///	- Objects left by a finished thread are taken over by the next reclamation of any thread.
+///
+namespace smart_ptr
+{
+namespace detail
+{
+
+class epoch_domain
+{
+public:
+	using reclaimer = void (*)(void*) noexcept;
+
+private:
+	struct record
+	{
+		/// Epoch observed on entry to the outermost guard. Zero outside of guards.
+		std::atomic<std::uint64_t> epoch_{0};
+		std::atomic<bool> in_use_{true};
+		record* next_{nullptr};
+	};
+
+	struct retired
+	{
+		std::uint64_t epoch_;
+		void* pointer_;
+		reclaimer reclaim_;
+	};
+
+	using registry = record_registry<record, retired>;
+
+	static constexpr std::size_t retire_batch = 64;
+
+	std::atomic<std::uint64_t> global_{1};
+	registry records_;
+
+	struct thread_state
+	{
+		record* record_{instance().records_.acquire()};
+		int nesting_{0};
+		std::vector<retired> limbo_;
+
+		~thread_state()
+		{
+			record_->epoch_.store(0, std::memory_order_release);
+			registry::release(record_);
+			instance().records_.finish_thread(limbo_);
+		}
+	};
+
+	static thread_state& local_()
+	{
+		thread_local thread_state state;
+		return state;
+	}
+
+	/// Global epoch moves on only when every thread inside a guard has seen the current one.
+	bool try_advance_()
+	{
+		std::uint64_t current = global_.load(std::memory_order_seq_cst);
+		for (record* rec = records_.head(); rec; rec = rec->next_)
+		{
+			const std::uint64_t observed = rec->epoch_.load(std::memory_order_seq_cst);
+			if (observed != 0 && observed != current)
+			{
+				return false;
+			}
+		}
+		return global_.compare_exchange_strong(current, current + 1, std::memory_order_seq_cst);
+	}
+
+	void reclaim_(std::vector<retired>& list)
+	{
+		const std::vector<retired> candidates = records_.detach(list);
+		const std::uint64_t safe = global_.load(std::memory_order_seq_cst);
+		std::vector<retired> reclaimable;
+		for (const retired& item : candidates)
+		{
+			// Reader which could have borrowed the object announced at most item.epoch_ + 1.
+			if (item.epoch_ + 2 <= safe)
+			{
+				reclaimable.push_back(item);
+			}
+			else
+			{
+				list.push_back(item);
+			}
+		}
+		for (const retired& item : reclaimable)
+		{
+			item.reclaim_(item.pointer_);
+		}
+	}
+
+public:
+	static epoch_domain& instance()
+	{
+		return immortal_instance<epoch_domain>();
+	}
+
+	static void enter()
+	{
+		thread_state& state = local_();
+		if (state.nesting_++ == 0)
+		{
+			// Must be visible before anything is borrowed. Seq_cst store pairs with seq_cst loads in try_advance_.
+			state.record_->epoch_.store(instance().global_.load(std::memory_order_relaxed), std::memory_order_seq_cst);
+			// Store followed by acquire loads of borrow() may be reordered (store buffer). Fence keeps them after it.
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+		}
+	}
+
+	static void leave() noexcept
+	{
+		thread_state& state = local_();
+		if (--state.nesting_ == 0)
+		{
+			state.record_->epoch_.store(0, std::memory_order_release);
+		}
+	}
+
+	static void retire(void* pointer, const reclaimer reclaim)
+	{
+		auto& domain = instance();
+		const std::uint64_t epoch = domain.global_.load(std::memory_order_seq_cst);
+		if (registry::finished())
+		{
+			domain.records_.orphan({epoch, pointer, reclaim});
+			return;
+		}
+		auto& limbo = local_().limbo_;
+		limbo.push_back({epoch, pointer, reclaim});
+		if (limbo.size() % retire_batch == 0)
+		{
+			domain.try_advance_();
+			domain.reclaim_(limbo);
+		}
+	}
+
+	static void clean_up()
+	{
+		if (registry::finished())
+		{
+			return;
+		}
+		auto& domain = instance();
+		domain.try_advance_();
+		domain.try_advance_();
+		domain.reclaim_(local_().limbo_);
+	}
+};
+
+/// Manager of control blocks created by make_epoch_shared. Same block as make_shared, only destruction of payload is deferred.
+template<typename T>
+struct epoch_payload
+{
+	using control_block = typename shared_ptr<T>::control_block;
+	using inplace_block = typename shared_ptr<T>::template inplace_control_block<std::allocator<std::remove_cv_t<T>>>;
+
+	static void manage(control_block* control, const typename control_block::action what) noexcept
+	{
+		if (what == control_block::action::destroy_payload)
+		{
+			// Weak reference keeps the block (payload lives inside it) until the object is reclaimed.
+			++control->weak_usages_;
+			epoch_domain::retire(control, &reclaim);
+		}
+		else
+		{
+			inplace_block::manage(control, what);
+		}
+	}
+
+	static void reclaim(void* pointer) noexcept
+	{
+		auto* control = static_cast<control_block*>(pointer);
+		inplace_block::manage(control, control_block::action::destroy_payload);
+		if (--control->weak_usages_ == 0)
+		{
+			inplace_block::manage(control, control_block::action::free_block);
+		}
+	}
+
+	template<typename... Args>
+	static shared_ptr<T> make(Args&&... args)
+	{
+		shared_ptr<T> result = make_shared<T>(std::forward<Args>(args)...);
+		result.control_->manage_ = &manage;
+		return result;
+	}
+
+	static bool is_epoch_reclaimed(const control_block* control) noexcept
+	{
+		return control->manage_ == &manage;
+	}
+};
+
+}
+
+/// Scope in which raw pointers borrowed from shared slots stay valid. Nestable. Not movable.
+class epoch_guard
+{
+public:
+	epoch_guard()
+	{
+		detail::epoch_domain::enter();
+	}
+
+	~epoch_guard()
+	{
+		detail::epoch_domain::leave();
+	}
+
+	epoch_guard(const epoch_guard&) = delete;
+	epoch_guard& operator=(const epoch_guard&) = delete;
+};
+
+/// Like make_shared, but destruction of the object waits until no epoch_guard can still borrow it.
+template<typename T, typename... Args>
+shared_ptr<T> make_epoch_shared(Args&&... args)
+{
+	static_assert(!detail::is_ref_counted<T, atomic_counting>, "ref_counted object has no separate payload whose destruction could be deferred");
+	return detail::epoch_payload<T>::make(std::forward<Args>(args)...);
+}
+
+/// Tries to advance the epoch and destroys retired objects of this thread (and of finished threads) nobody can borrow any more.
+inline void epoch_clean_up()
+{
+	detail::epoch_domain::clean_up();
+}
+
+}
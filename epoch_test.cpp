@@ -0,0 +1,108 @@
+#include "catch.hpp"
+#include "alive_counter.h"
+#include "atomic_shared_ptr.h"
+#include "epoch.h"
+
+#include <thread>
+#include <vector>
+
+namespace
+{
+struct versioned : alive_counter<versioned>
+{
+	int version_;
+
+	explicit versioned(const int version)
+		: version_(version)
+	{
+	}
+};
+}
+
+TEST_CASE("make_epoch_shared defers destruction")
+{
+	SECTION("Destroyed by clean up after last owner")
+	{
+		auto shared = smart_ptr::make_epoch_shared<versioned>(1);
+		smart_ptr::weak_ptr<versioned> weak(shared);
+		shared = smart_ptr::shared_ptr<versioned>{};
+		REQUIRE(weak.expired());
+		REQUIRE(!weak.lock());
+		REQUIRE(versioned::alive_ == 1);
+		smart_ptr::epoch_clean_up();
+		REQUIRE(versioned::alive_ == 0);
+	}
+
+	SECTION("Borrowed object outlives the store")
+	{
+		smart_ptr::atomic_shared_ptr<versioned> slot(smart_ptr::make_epoch_shared<versioned>(2));
+		{
+			const smart_ptr::epoch_guard guard;
+			const versioned* borrowed = slot.borrow(guard);
+			REQUIRE(borrowed->version_ == 2);
+			slot.store(smart_ptr::make_epoch_shared<versioned>(3));
+			smart_ptr::epoch_clean_up();
+			REQUIRE(versioned::alive_ == 2);
+			REQUIRE(borrowed->version_ == 2);
+			REQUIRE(slot.borrow(guard)->version_ == 3);
+		}
+		smart_ptr::epoch_clean_up();
+		REQUIRE(versioned::alive_ == 1);
+	}
+
+	SECTION("Nested guards")
+	{
+		smart_ptr::atomic_shared_ptr<versioned> slot(smart_ptr::make_epoch_shared<versioned>(4));
+		const smart_ptr::epoch_guard outer;
+		{
+			const smart_ptr::epoch_guard inner;
+			REQUIRE(slot.borrow(inner)->version_ == 4);
+		}
+		const versioned* borrowed = slot.borrow(outer);
+		slot.store(smart_ptr::shared_ptr<versioned>{});
+		smart_ptr::epoch_clean_up();
+		REQUIRE(borrowed->version_ == 4);
+		REQUIRE(versioned::alive_ == 1);
+	}
+
+	smart_ptr::epoch_clean_up();
+	REQUIRE(versioned::alive_ == 0);
+}
+
+TEST_CASE("Epoch readers racing writer")
+{
+	constexpr int iterations = 20'000;
+	{
+		smart_ptr::atomic_shared_ptr<versioned> slot(smart_ptr::make_epoch_shared<versioned>(0));
+		std::atomic<bool> wrong_value{false};
+		std::vector<std::thread> readers;
+		for (int r = 0; r < 3; ++r)
+		{
+			readers.emplace_back([&slot, &wrong_value]
+			{
+				int last = 0;
+				for (int i = 0; i < iterations; ++i)
+				{
+					const smart_ptr::epoch_guard guard;
+					const int version = slot.borrow(guard)->version_;
+					if (version < last)
+					{
+						wrong_value = true;
+					}
+					last = version;
+				}
+			});
+		}
+		for (int i = 1; i <= iterations; ++i)
+		{
+			slot.store(smart_ptr::make_epoch_shared<versioned>(i));
+		}
+		for (auto& reader : readers)
+		{
+			reader.join();
+		}
+		REQUIRE(!wrong_value);
+	}
+	smart_ptr::epoch_clean_up();
+	REQUIRE(versioned::alive_ == 0);
+}
@@ -0,0 +1,361 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <utility>
+#include <vector>
+
+#include "reclamation.h"
+#include "shared_ptr.h"
+
+/// Hazard pointers (API similar to C++26 std::hazard_pointer) and a shared_ptr slot read under their protection.
+///
+/// hazard_shared_slot<T> owns one strong reference to the published object.
+///	- read() publishes the control block in a hazard pointer of this thread and validates the slot. usages_ is not touched.
+///	- store() does not release the old reference. It retires it. Reference is released through the usual
+///	  shared_ptr path (finish_one_instance_) only after no hazard pointer covers the old control block.
+///	- reader::lock() makes a counted shared_ptr from protected read when the caller needs to keep the object.
+///
+/// Domain:
+///	- One process wide domain. Hazard records are never freed. Records are cached per thread, so constructing
+///	  a hazard_pointer costs no atomic operation after warm up.
+///	- Every thread keeps its own list of retired pointers and scans hazards when the list is long enough.
+///	- Retired pointers left by a finished thread are taken over by the next scan of any thread.
+///
+namespace smart_ptr
+{
+namespace detail
+{
+
+class hazard_domain
+{
+public:
+	using reclaimer = void (*)(void*) noexcept;
+
+	struct record
+	{
+		std::atomic<void*> pointer_{nullptr};
+		std::atomic<bool> in_use_{true};
+		record* next_{nullptr};
+	};
+
+private:
+	struct retired
+	{
+		void* pointer_;
+		reclaimer reclaim_;
+	};
+
+	using registry = record_registry<record, retired>;
+
+	registry records_;
+
+	static constexpr std::size_t min_scan_threshold = 64;
+
+	struct thread_state
+	{
+		std::vector<record*> free_records_;
+		std::vector<retired> retired_;
+
+		~thread_state()
+		{
+			for (record* rec : free_records_)
+			{
+				registry::release(rec);
+			}
+			instance().records_.finish_thread(retired_);
+		}
+	};
+
+	static thread_state& local_()
+	{
+		thread_local thread_state state;
+		return state;
+	}
+
+	std::vector<void*> hazards_() const
+	{
+		std::vector<void*> hazards;
+		for (record* rec = records_.head(); rec; rec = rec->next_)
+		{
+			if (void* pointer = rec->pointer_.load(std::memory_order_seq_cst))
+			{
+				hazards.push_back(pointer);
+			}
+		}
+		std::sort(hazards.begin(), hazards.end());
+		return hazards;
+	}
+
+	/// Reclaims what no hazard covers. Hazards are read after the orphans are taken: an orphan was unpublished before.
+	void scan_(std::vector<retired>& list)
+	{
+		const std::vector<retired> candidates = records_.detach(list);
+		const std::vector<void*> hazards = hazards_();
+		std::vector<retired> reclaimable;
+		for (const retired& item : candidates)
+		{
+			if (std::binary_search(hazards.begin(), hazards.end(), item.pointer_))
+			{
+				list.push_back(item);
+			}
+			else
+			{
+				reclaimable.push_back(item);
+			}
+		}
+		for (const retired& item : reclaimable)
+		{
+			item.reclaim_(item.pointer_);
+		}
+	}
+
+public:
+	static hazard_domain& instance()
+	{
+		return immortal_instance<hazard_domain>();
+	}
+
+	static record* acquire()
+	{
+		if (!registry::finished())
+		{
+			auto& cache = local_().free_records_;
+			if (!cache.empty())
+			{
+				record* rec = cache.back();
+				cache.pop_back();
+				return rec;
+			}
+		}
+		return instance().records_.acquire();
+	}
+
+	static void release(record* rec) noexcept
+	{
+		rec->pointer_.store(nullptr, std::memory_order_release);
+		if (!registry::finished())
+		{
+			local_().free_records_.push_back(rec);
+			return;
+		}
+		registry::release(rec);
+	}
+
+	static void retire(void* pointer, const reclaimer reclaim)
+	{
+		auto& domain = instance();
+		if (registry::finished())
+		{
+			domain.records_.orphan({pointer, reclaim});
+			return;
+		}
+		auto& list = local_().retired_;
+		list.push_back({pointer, reclaim});
+		if (list.size() >= std::max(min_scan_threshold, 2 * static_cast<std::size_t>(domain.records_.record_count())))
+		{
+			domain.scan_(list);
+		}
+	}
+
+	static void clean_up()
+	{
+		if (!registry::finished())
+		{
+			instance().scan_(local_().retired_);
+		}
+	}
+};
+
+}
+
+/// Protects one pointer at a time. Move only.
+class hazard_pointer
+{
+	detail::hazard_domain::record* record_{nullptr};
+
+	explicit hazard_pointer(detail::hazard_domain::record* rec) noexcept
+		: record_(rec)
+	{
+	}
+
+	friend hazard_pointer make_hazard_pointer();
+
+public:
+	hazard_pointer() noexcept = default;
+
+	hazard_pointer(hazard_pointer&& other) noexcept
+		: record_(std::exchange(other.record_, nullptr))
+	{
+	}
+
+	hazard_pointer& operator=(hazard_pointer&& other) noexcept
+	{
+		std::swap(record_, other.record_);
+		return *this;
+	}
+
+	~hazard_pointer()
+	{
+		if (record_)
+		{
+			detail::hazard_domain::release(record_);
+		}
+	}
+
+	[[nodiscard]] bool empty() const noexcept
+	{
+		return !record_;
+	}
+
+	template<typename U>
+	bool try_protect(U*& ptr, const std::atomic<U*>& src) noexcept
+	{
+		U* expected = ptr;
+		reset_protection(expected);
+		ptr = src.load(std::memory_order_seq_cst);
+		if (ptr != expected)
+		{
+			reset_protection();
+			return false;
+		}
+		return true;
+	}
+
+	/// Returned pointer stays valid until protection is reset even when src is changed meanwhile.
+	template<typename U>
+	U* protect(const std::atomic<U*>& src) noexcept
+	{
+		U* ptr = src.load(std::memory_order_relaxed);
+		while (!try_protect(ptr, src))
+		{
+		}
+		return ptr;
+	}
+
+	template<typename U>
+	void reset_protection(const U* ptr) noexcept
+	{
+		record_->pointer_.store(const_cast<U*>(ptr), std::memory_order_seq_cst);
+	}
+
+	void reset_protection(std::nullptr_t = nullptr) noexcept
+	{
+		record_->pointer_.store(nullptr, std::memory_order_release);
+	}
+};
+
+inline hazard_pointer make_hazard_pointer()
+{
+	return hazard_pointer{detail::hazard_domain::acquire()};
+}
+
+/// Reclaims retired pointers of this thread (and of finished threads) which are not protected any more.
+inline void hazard_pointer_clean_up()
+{
+	detail::hazard_domain::clean_up();
+}
+
+template<typename T>
+class hazard_shared_slot
+{
+	using control_block = typename shared_ptr<T>::control_block;
+
+	/// Owns one strong reference.
+	std::atomic<control_block*> control_{nullptr};
+
+	static void release_(void* control) noexcept
+	{
+		// Adopts the reference of the slot and finishes it like any other shared_ptr.
+		shared_ptr<T>{static_cast<control_block*>(control)};
+	}
+
+	static void retire_(control_block* control)
+	{
+		if (control)
+		{
+			detail::hazard_domain::retire(control, &release_);
+		}
+	}
+
+public:
+	class reader
+	{
+		friend class hazard_shared_slot;
+
+		hazard_pointer hazard_{make_hazard_pointer()};
+		control_block* control_{nullptr};
+
+		explicit reader(const std::atomic<control_block*>& src)
+			: control_(hazard_.protect(src))
+		{
+		}
+
+	public:
+		[[nodiscard]] explicit operator bool() const noexcept
+		{
+			return static_cast<bool>(control_);
+		}
+
+		[[nodiscard]] T* get() const noexcept
+		{
+			return control_ ? static_cast<T*>(control_->payload_) : nullptr;
+		}
+
+		[[nodiscard]] T& operator*() const noexcept
+		{
+			return *get();
+		}
+
+		[[nodiscard]] T* operator->() const noexcept
+		{
+			return get();
+		}
+
+		/// One increment. Strong count is not zero: retired reference of the slot is not released while protected.
+		[[nodiscard]] shared_ptr<T> lock() const noexcept
+		{
+			if (control_)
+			{
+				++control_->usages_;
+			}
+			return shared_ptr<T>{control_};
+		}
+	};
+
+	constexpr hazard_shared_slot() noexcept = default;
+
+	explicit hazard_shared_slot(shared_ptr<T> desired) noexcept
+	{
+		desired.require_not_aliased_();
+		control_.store(std::exchange(desired.control_, nullptr), std::memory_order_relaxed);
+	}
+
+	hazard_shared_slot(const hazard_shared_slot&) = delete;
+	hazard_shared_slot& operator=(const hazard_shared_slot&) = delete;
+
+	~hazard_shared_slot()
+	{
+		retire_(control_.load(std::memory_order_relaxed));
+	}
+
+	/// Slot keeps the control block only. desired must point to its payload (not aliased).
+	void store(shared_ptr<T> desired)
+	{
+		desired.require_not_aliased_();
+		retire_(control_.exchange(std::exchange(desired.control_, nullptr), std::memory_order_seq_cst));
+	}
+
+	/// Hazard protected access. Valid as long as the reader lives.
+	[[nodiscard]] reader read() const
+	{
+		return reader{control_};
+	}
+
+	[[nodiscard]] shared_ptr<T> load() const
+	{
+		return read().lock();
+	}
+};
+
+}
@@ -0,0 +1,117 @@
+#include "catch.hpp"
+#include "alive_counter.h"
+#include "hazard_pointer.h"
+
+#include <thread>
+#include <vector>
+
+namespace
+{
+struct tracked : alive_counter<tracked>
+{
+	int value_;
+
+	explicit tracked(const int value)
+		: value_(value)
+	{
+	}
+};
+}
+
+TEST_CASE("hazard_pointer protects a raw pointer")
+{
+	int first = 1;
+	int second = 2;
+	std::atomic<int*> src{&first};
+	auto hazard = smart_ptr::make_hazard_pointer();
+	REQUIRE(!hazard.empty());
+	REQUIRE(hazard.protect(src) == &first);
+
+	int* ptr = &first;
+	src = &second;
+	REQUIRE(!hazard.try_protect(ptr, src));
+	REQUIRE(ptr == &second);
+	REQUIRE(hazard.try_protect(ptr, src));
+
+	const smart_ptr::hazard_pointer moved{std::move(hazard)};
+	REQUIRE(hazard.empty());  // NOLINT(bugprone-use-after-move) // Intentionally testing moved-from object.
+	REQUIRE(!moved.empty());
+}
+
+TEST_CASE("hazard_shared_slot")
+{
+	SECTION("Reader does not change strong count")
+	{
+		auto payload = smart_ptr::make_shared<tracked>(1);
+		smart_ptr::hazard_shared_slot<tracked> slot(payload);
+		REQUIRE(payload.use_count() == 2);
+		const auto reader = slot.read();
+		REQUIRE(reader->value_ == 1);
+		REQUIRE(payload.use_count() == 2);
+		const auto locked = reader.lock();
+		REQUIRE(payload.use_count() == 3);
+	}
+
+	SECTION("Replaced object lives while protected")
+	{
+		smart_ptr::hazard_shared_slot<tracked> slot(smart_ptr::make_shared<tracked>(2));
+		{
+			const auto reader = slot.read();
+			slot.store(smart_ptr::make_shared<tracked>(3));
+			smart_ptr::hazard_pointer_clean_up();
+			REQUIRE(tracked::alive_ == 2);
+			REQUIRE(reader->value_ == 2);
+			REQUIRE(slot.read()->value_ == 3);
+		}
+		smart_ptr::hazard_pointer_clean_up();
+		REQUIRE(tracked::alive_ == 1);
+		REQUIRE(slot.load()->value_ == 3);
+	}
+
+	SECTION("Empty slot")
+	{
+		const smart_ptr::hazard_shared_slot<tracked> slot;
+		REQUIRE(!slot.read());
+		REQUIRE(!slot.load());
+	}
+
+	smart_ptr::hazard_pointer_clean_up();
+	REQUIRE(tracked::alive_ == 0);
+}
+
+TEST_CASE("hazard_shared_slot readers racing writer")
+{
+	constexpr int iterations = 20'000;
+	{
+		smart_ptr::hazard_shared_slot<tracked> slot(smart_ptr::make_shared<tracked>(0));
+		std::atomic<bool> wrong_value{false};
+		std::vector<std::thread> readers;
+		for (int r = 0; r < 3; ++r)
+		{
+			readers.emplace_back([&slot, &wrong_value]
+			{
+				int last = 0;
+				for (int i = 0; i < iterations; ++i)
+				{
+					const auto reader = slot.read();
+					if (reader->value_ < last)
+					{
+						wrong_value = true;
+					}
+					last = reader->value_;
+				}
+			});
+		}
+		for (int i = 1; i <= iterations; ++i)
+		{
+			slot.store(smart_ptr::make_shared<tracked>(i));
+		}
+		for (auto& reader : readers)
+		{
+			reader.join();
+		}
+		REQUIRE(!wrong_value);
+	}
+	smart_ptr::hazard_pointer_clean_up();
+	REQUIRE(tracked::alive_ == 0);
+}
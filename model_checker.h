@@ -0,0 +1,491 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/// Stateless model checker for the memory orders of counting policies. Test support, not part of the library.
+///
+///	- explore() runs a small scenario once for every interleaving of the atomic operations of its workers.
+///	  Workers are real threads, but only one of them runs at a time. Before every operation on a checked_atomic
+///	  the running worker lets the checker choose which worker continues. Schedules are enumerated depth first.
+///	- Happens-before is tracked by vector clocks as the C++ memory model defines it: acquire operations
+///	  synchronize with release operations they read from, RMWs continue release sequences, relaxed operations
+///	  order nothing. Loads always read the latest value. So orders which allow a stale read are not explored,
+///	  missing happens-before edges are.
+///	- Three and more workers have many interleavings. explore() can be bounded to schedules with at most
+///	  preemption_bound switches away from a worker which could continue (as CHESS does). Unbounded by default.
+///	- Objects announced by created() are checked: destroyed exactly once, after every access of every thread
+///	  in happens-before order, never accessed afterwards. checked_atomic announces itself, so freeing
+///	  a control block is checked against every counter operation of other threads.
+///
+namespace model_check
+{
+
+using clock_vector = std::vector<std::uint32_t>;
+
+struct report
+{
+	long executions_{0};
+	/// First violation found. Exploration stops there. Empty when every interleaving is correct.
+	std::string violation_;
+};
+
+class checker
+{
+	struct choice
+	{
+		int taken_;
+		int count_;
+	};
+
+	struct object
+	{
+		bool alive_;
+		/// Clock of each thread at its last access.
+		clock_vector accesses_;
+	};
+
+	static inline checker* active_{nullptr};
+	/// 0 is the thread calling explore(). Workers are 1 ... n.
+	static inline thread_local int thread_{0};
+
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	int running_{0};
+	std::vector<bool> finished_;
+	std::vector<clock_vector> clocks_;
+	std::unordered_map<const void*, object> objects_;
+	/// Clock released by the last release sequence of each atomic.
+	std::unordered_map<const void*, clock_vector> released_;
+	std::vector<choice> schedule_;
+	std::size_t depth_{0};
+	int preemptions_{0};
+	int preemption_bound_;
+	std::string violation_;
+
+	checker(const int threads, const int preemption_bound)
+		: finished_(threads)
+		, clocks_(threads)
+		, preemption_bound_(preemption_bound)
+	{
+	}
+
+	static bool is_acquire_(const std::memory_order order) noexcept
+	{
+		return order == std::memory_order_acquire || order == std::memory_order_acq_rel || order == std::memory_order_seq_cst || order == std::memory_order_consume;
+	}
+
+	static bool is_release_(const std::memory_order order) noexcept
+	{
+		return order == std::memory_order_release || order == std::memory_order_acq_rel || order == std::memory_order_seq_cst;
+	}
+
+	static void join_(clock_vector& into, const clock_vector& other)
+	{
+		for (std::size_t i = 0; i < other.size(); ++i)
+		{
+			into[i] = std::max(into[i], other[i]);
+		}
+	}
+
+	void fail_(std::string message)
+	{
+		if (violation_.empty())
+		{
+			violation_ = std::move(message) + " (thread " + std::to_string(thread_) + ")";
+		}
+	}
+
+	/// Called with mutex_ locked. current is the worker asking to continue, 0 when none.
+	int pick_(const int current)
+	{
+		if (current != 0 && preemptions_ == preemption_bound_)
+		{
+			return current;
+		}
+		std::vector<int> runnable;
+		for (int i = 1; i < static_cast<int>(finished_.size()); ++i)
+		{
+			if (!finished_[i])
+			{
+				runnable.push_back(i);
+			}
+		}
+		if (runnable.empty())
+		{
+			return 0;
+		}
+		if (runnable.size() == 1)
+		{
+			return runnable.front();
+		}
+		if (depth_ == schedule_.size())
+		{
+			schedule_.push_back({0, static_cast<int>(runnable.size())});
+		}
+		const int next = runnable[schedule_[depth_++].taken_];
+		if (current != 0 && next != current)
+		{
+			++preemptions_;
+		}
+		return next;
+	}
+
+	void wait_turn_(std::unique_lock<std::mutex>& lock, const int me)
+	{
+		wake_.wait(lock, [this, me] { return running_ == me; });
+	}
+
+	void yield_()
+	{
+		std::unique_lock lock(mutex_);
+		running_ = pick_(thread_);
+		if (running_ != thread_)
+		{
+			wake_.notify_all();
+			wait_turn_(lock, thread_);
+		}
+	}
+
+	void tick_()
+	{
+		++clocks_[thread_][thread_];
+	}
+
+	template<typename State>
+	void run_(const std::vector<std::function<void(State&)>>& workers, State& state)
+	{
+		const int threads = static_cast<int>(clocks_.size());
+		for (int i = 1; i < threads; ++i)
+		{
+			// Thread start synchronizes with everything the creator did.
+			clocks_[i] = clocks_[0];
+			clocks_[i][i] = 1;
+		}
+		tick_();
+		std::vector<std::thread> started;
+		for (int i = 1; i < threads; ++i)
+		{
+			started.emplace_back([this, &workers, &state, i]
+			{
+				thread_ = i;
+				{
+					std::unique_lock lock(mutex_);
+					wait_turn_(lock, i);
+				}
+				workers[i - 1](state);
+				std::lock_guard lock(mutex_);
+				finished_[i] = true;
+				running_ = pick_(0);
+				wake_.notify_all();
+			});
+		}
+		{
+			std::unique_lock lock(mutex_);
+			running_ = pick_(0);
+			wake_.notify_all();
+			wait_turn_(lock, 0);
+		}
+		for (auto& thread : started)
+		{
+			thread.join();
+		}
+		for (int i = 1; i < threads; ++i)
+		{
+			join_(clocks_[0], clocks_[i]);
+		}
+		tick_();
+	}
+
+	void begin_execution_()
+	{
+		std::fill(finished_.begin(), finished_.end(), false);
+		for (std::size_t i = 0; i < clocks_.size(); ++i)
+		{
+			clocks_[i].assign(clocks_.size(), 0);
+			clocks_[i][i] = 1;
+		}
+		objects_.clear();
+		released_.clear();
+		running_ = 0;
+		depth_ = 0;
+		preemptions_ = 0;
+		active_ = this;
+	}
+
+	void end_execution_()
+	{
+		for (const auto& [address, record] : objects_)
+		{
+			if (record.alive_)
+			{
+				fail_("object never destroyed");
+			}
+		}
+		active_ = nullptr;
+	}
+
+	bool next_schedule_()
+	{
+		schedule_.resize(depth_);
+		while (!schedule_.empty() && schedule_.back().taken_ + 1 == schedule_.back().count_)
+		{
+			schedule_.pop_back();
+		}
+		if (schedule_.empty())
+		{
+			return false;
+		}
+		++schedule_.back().taken_;
+		return true;
+	}
+
+public:
+	static constexpr int unbounded = -1;
+
+	/// Runs setup on the calling thread, the workers concurrently (one per thread), then destroys the state.
+	/// Repeats for every interleaving until all are explored or a violation is found.
+	template<typename State>
+	static report explore(const std::function<std::unique_ptr<State>()>& setup, const std::vector<std::function<void(State&)>>& workers, const int preemption_bound = unbounded)
+	{
+		checker instance(static_cast<int>(workers.size()) + 1, preemption_bound);
+		report result;
+		do
+		{
+			instance.begin_execution_();
+			{
+				const std::unique_ptr<State> state = setup();
+				instance.run_(workers, *state);
+			}
+			instance.end_execution_();
+			++result.executions_;
+			if (!instance.violation_.empty())
+			{
+				result.violation_ = instance.violation_;
+				break;
+			}
+		} while (instance.next_schedule_());
+		return result;
+	}
+
+	/// Number of the calling thread: 0 for the one calling explore(), 1 ... n for the workers.
+	static int thread_index() noexcept
+	{
+		return thread_;
+	}
+
+	static void created(const void* address)
+	{
+		if (active_)
+		{
+			active_->objects_[address] = {true, clock_vector(active_->clocks_.size(), 0)};
+			active_->released_.erase(address);
+		}
+	}
+
+	static void accessed(const void* address)
+	{
+		if (!active_)
+		{
+			return;
+		}
+		const auto found = active_->objects_.find(address);
+		if (found == active_->objects_.end())
+		{
+			return;
+		}
+		if (!found->second.alive_)
+		{
+			active_->fail_("access after destruction");
+			return;
+		}
+		found->second.accesses_[thread_] = active_->clocks_[thread_][thread_];
+	}
+
+	static void destroyed(const void* address)
+	{
+		if (!active_)
+		{
+			return;
+		}
+		const auto found = active_->objects_.find(address);
+		if (found == active_->objects_.end())
+		{
+			return;
+		}
+		if (!found->second.alive_)
+		{
+			active_->fail_("destroyed twice");
+			return;
+		}
+		const clock_vector& now = active_->clocks_[thread_];
+		for (std::size_t other = 0; other < now.size(); ++other)
+		{
+			if (found->second.accesses_[other] > now[other])
+			{
+				active_->fail_("destroyed without happens-before after access of thread " + std::to_string(other));
+			}
+		}
+		found->second.alive_ = false;
+	}
+
+	/// Scheduling point and access check before each atomic operation.
+	static void before_atomic(const void* address)
+	{
+		if (!active_)
+		{
+			return;
+		}
+		if (thread_ != 0)
+		{
+			active_->yield_();
+		}
+		accessed(address);
+	}
+
+	static void after_load(const void* address, const std::memory_order order)
+	{
+		if (!active_)
+		{
+			return;
+		}
+		if (is_acquire_(order))
+		{
+			join_(active_->clocks_[thread_], active_->released_[address].empty() ? clock_vector(active_->clocks_.size(), 0) : active_->released_[address]);
+		}
+		active_->tick_();
+	}
+
+	static void after_store(const void* address, const std::memory_order order)
+	{
+		if (!active_)
+		{
+			return;
+		}
+		// Store (unlike RMW) starts a new release sequence.
+		active_->released_[address] = is_release_(order) ? active_->clocks_[thread_] : clock_vector(active_->clocks_.size(), 0);
+		active_->tick_();
+	}
+
+	static void after_rmw(const void* address, const std::memory_order order)
+	{
+		if (!active_)
+		{
+			return;
+		}
+		clock_vector& released = active_->released_[address];
+		if (released.empty())
+		{
+			released.assign(active_->clocks_.size(), 0);
+		}
+		if (is_acquire_(order))
+		{
+			join_(active_->clocks_[thread_], released);
+		}
+		if (is_release_(order))
+		{
+			join_(released, active_->clocks_[thread_]);
+		}
+		active_->tick_();
+	}
+};
+
+/// Drop-in for std::atomic in basic_atomic_counting, basic_packed_counting and basic_sharded_counting.
+template<typename T>
+class checked_atomic
+{
+	std::atomic<T> value_;
+
+public:
+	checked_atomic(const T value) noexcept
+		: value_(value)
+	{
+		checker::created(this);
+	}
+
+	~checked_atomic()
+	{
+		checker::destroyed(this);
+	}
+
+	checked_atomic(const checked_atomic&) = delete;
+	checked_atomic& operator=(const checked_atomic&) = delete;
+
+	// Real operations are relaxed: only one thread runs at a time and the hand over is synchronized anyway.
+	T load(const std::memory_order order = std::memory_order_seq_cst) const
+	{
+		checker::before_atomic(this);
+		const T result = value_.load(std::memory_order_relaxed);
+		checker::after_load(this, order);
+		return result;
+	}
+
+	void store(const T value, const std::memory_order order = std::memory_order_seq_cst)
+	{
+		checker::before_atomic(this);
+		value_.store(value, std::memory_order_relaxed);
+		checker::after_store(this, order);
+	}
+
+	T fetch_add(const T arg, const std::memory_order order = std::memory_order_seq_cst)
+	{
+		checker::before_atomic(this);
+		const T result = value_.fetch_add(arg, std::memory_order_relaxed);
+		checker::after_rmw(this, order);
+		return result;
+	}
+
+	T fetch_sub(const T arg, const std::memory_order order = std::memory_order_seq_cst)
+	{
+		checker::before_atomic(this);
+		const T result = value_.fetch_sub(arg, std::memory_order_relaxed);
+		checker::after_rmw(this, order);
+		return result;
+	}
+
+	T fetch_and(const T arg, const std::memory_order order = std::memory_order_seq_cst)
+	{
+		checker::before_atomic(this);
+		const T result = value_.fetch_and(arg, std::memory_order_relaxed);
+		checker::after_rmw(this, order);
+		return result;
+	}
+
+	/// Never fails spuriously, so every execution is finite.
+	bool compare_exchange_weak(T& expected, const T desired, const std::memory_order success = std::memory_order_seq_cst, const std::memory_order failure = std::memory_order_seq_cst)
+	{
+		checker::before_atomic(this);
+		if (value_.compare_exchange_strong(expected, desired, std::memory_order_relaxed))
+		{
+			checker::after_rmw(this, success);
+			return true;
+		}
+		checker::after_load(this, failure);
+		return false;
+	}
+
+	bool compare_exchange_strong(T& expected, const T desired, const std::memory_order success = std::memory_order_seq_cst, const std::memory_order failure = std::memory_order_seq_cst)
+	{
+		return compare_exchange_weak(expected, desired, success, failure);
+	}
+
+	T operator++()
+	{
+		return fetch_add(1) + 1;
+	}
+
+	T operator--()
+	{
+		return fetch_sub(1) - 1;
+	}
+};
+
+}
@@ -0,0 +1,231 @@
+#include "catch.hpp"
+#include "model_checker.h"
+#include "packed_counting.h"
+#include "sharded_counting.h"
+
+#include <optional>
+
+namespace
+{
+/// Payload which reports its accesses and destruction to the checker.
+struct probe
+{
+	int value_{1};
+
+	probe()
+	{
+		model_check::checker::created(this);
+	}
+
+	~probe()
+	{
+		model_check::checker::destroyed(this);
+	}
+
+	[[nodiscard]] int read() const
+	{
+		model_check::checker::accessed(this);
+		return value_;
+	}
+};
+
+template<typename Counting>
+struct references
+{
+	smart_ptr::shared_ptr<probe, Counting> first_;
+	smart_ptr::shared_ptr<probe, Counting> second_;
+	std::optional<smart_ptr::weak_ptr<probe, Counting>> weak_;
+};
+
+template<typename Counting>
+using worker = std::function<void(references<Counting>&)>;
+
+template<typename Counting>
+std::unique_ptr<references<Counting>> two_owners()
+{
+	auto result = std::make_unique<references<Counting>>();
+	result->first_ = smart_ptr::make_shared<probe, Counting>();
+	result->second_ = result->first_;
+	return result;
+}
+
+template<typename Counting>
+std::unique_ptr<references<Counting>> owner_and_observer()
+{
+	auto result = std::make_unique<references<Counting>>();
+	result->first_ = smart_ptr::make_shared<probe, Counting>();
+	result->weak_.emplace(result->first_);
+	return result;
+}
+
+template<typename Counting>
+std::unique_ptr<references<Counting>> two_owners_and_observer()
+{
+	auto result = two_owners<Counting>();
+	result->weak_.emplace(result->first_);
+	return result;
+}
+
+/// Both references copied on the setup thread: with sharded_counting they are counted on the same shard.
+template<typename Counting>
+std::unique_ptr<references<Counting>> two_copies()
+{
+	auto result = two_owners<Counting>();
+	result->first_ = result->second_;
+	return result;
+}
+
+template<typename Counting>
+void copy_and_release(references<Counting>& refs)
+{
+	const auto copy = refs.first_;
+	static_cast<void>(copy->read());
+	refs.first_.reset();
+}
+
+template<typename Counting>
+void release_second(references<Counting>& refs)
+{
+	static_cast<void>(refs.second_->read());
+	refs.second_.reset();
+}
+
+template<typename Counting>
+void release_first(references<Counting>& refs)
+{
+	static_cast<void>(refs.first_->read());
+	refs.first_.reset();
+}
+
+template<typename Counting>
+void lock_and_release_weak(references<Counting>& refs)
+{
+	if (const auto locked = refs.weak_->lock())
+	{
+		static_cast<void>(locked->read());
+	}
+	refs.weak_.reset();
+}
+
+/// use_count of atomic_counting may finish the zero itself.
+template<typename Counting>
+void check_expired_and_lock(references<Counting>& refs)
+{
+	if (!refs.weak_->expired())
+	{
+		if (const auto locked = refs.weak_->lock())
+		{
+			static_cast<void>(locked->read());
+		}
+	}
+	refs.weak_.reset();
+}
+
+template<typename Counting>
+void release_weak(references<Counting>& refs)
+{
+	refs.weak_.reset();
+}
+
+/// Scenarios of paralelism.md.
+template<typename Counting>
+void check_policy()
+{
+	using refs = references<Counting>;
+
+	SECTION("Copy and destroy on two threads")
+	{
+		const auto report = model_check::checker::explore<refs>(&two_owners<Counting>, {worker<Counting>(&copy_and_release<Counting>), worker<Counting>(&release_second<Counting>)});
+		INFO(report.violation_);
+		REQUIRE(report.violation_.empty());
+		REQUIRE(report.executions_ > 1);
+	}
+
+	SECTION("weak_ptr::lock while destroying the last shared_ptr")
+	{
+		const auto report = model_check::checker::explore<refs>(&owner_and_observer<Counting>, {worker<Counting>(&release_first<Counting>), worker<Counting>(&lock_and_release_weak<Counting>)});
+		INFO(report.violation_);
+		REQUIRE(report.violation_.empty());
+		REQUIRE(report.executions_ > 1);
+	}
+
+	SECTION("weak_ptr::expired and lock while destroying the last shared_ptr")
+	{
+		const auto report = model_check::checker::explore<refs>(&owner_and_observer<Counting>, {worker<Counting>(&release_first<Counting>), worker<Counting>(&check_expired_and_lock<Counting>)});
+		INFO(report.violation_);
+		REQUIRE(report.violation_.empty());
+		REQUIRE(report.executions_ > 1);
+	}
+
+	SECTION("Last weak_ptr and last shared_ptr destroyed together")
+	{
+		const auto report = model_check::checker::explore<refs>(&owner_and_observer<Counting>, {worker<Counting>(&release_weak<Counting>), worker<Counting>(&release_first<Counting>)});
+		INFO(report.violation_);
+		REQUIRE(report.violation_.empty());
+		REQUIRE(report.executions_ > 1);
+	}
+
+	SECTION("Copy, destroy and lock on three threads")
+	{
+		// Every schedule with up to three preemptions. Unbounded, packed_counting has millions of them.
+		const auto report = model_check::checker::explore<refs>(&two_owners_and_observer<Counting>,
+			{worker<Counting>(&copy_and_release<Counting>), worker<Counting>(&release_second<Counting>), worker<Counting>(&lock_and_release_weak<Counting>)}, 3);
+		INFO(report.violation_);
+		REQUIRE(report.violation_.empty());
+		REQUIRE(report.executions_ > 1);
+	}
+}
+
+/// Same shard for a worker in every execution: the checker replays schedules.
+struct checker_shard
+{
+	static std::size_t index() noexcept
+	{
+		return static_cast<std::size_t>(model_check::checker::thread_index());
+	}
+};
+
+/// Decrement without acquire and release. Counts are right, the order is not.
+template<template<typename> class Atomic>
+struct relaxed_release_counting : smart_ptr::basic_atomic_counting<Atomic>
+{
+	bool release_strong() noexcept
+	{
+		return this->usages_.fetch_sub(1, std::memory_order_relaxed) == 1;
+	}
+};
+}
+
+TEST_CASE("Model check atomic_counting")
+{
+	check_policy<smart_ptr::basic_atomic_counting<model_check::checked_atomic>>();
+}
+
+TEST_CASE("Model check packed_counting")
+{
+	check_policy<smart_ptr::basic_packed_counting<model_check::checked_atomic>>();
+}
+
+TEST_CASE("Model check sharded_counting")
+{
+	// Two shards: workers 1 and 2 count on different shards, the setup thread shares one with worker 2.
+	using counting = smart_ptr::basic_sharded_counting<model_check::checked_atomic, 2, checker_shard>;
+	check_policy<counting>();
+
+	SECTION("Two threads release references of one shard")
+	{
+		const auto report = model_check::checker::explore<references<counting>>(&two_copies<counting>,
+			{worker<counting>(&release_first<counting>), worker<counting>(&release_second<counting>)});
+		INFO(report.violation_);
+		REQUIRE(report.violation_.empty());
+		REQUIRE(report.executions_ > 1);
+	}
+}
+
+TEST_CASE("Model checker finds relaxed decrement")
+{
+	using counting = relaxed_release_counting<model_check::checked_atomic>;
+	const auto report = model_check::checker::explore<references<counting>>(&two_owners<counting>,
+		{worker<counting>(&copy_and_release<counting>), worker<counting>(&release_second<counting>)});
+	REQUIRE(report.violation_.find("happens-before") != std::string::npos);
+}
@@ -0,0 +1,296 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "shared_ptr.h"
+
+/// Pool of recycled objects (messages, buffers) handing out shared_ptr<T>. Last release of a pooled object returns it,
+/// together with its control block, to the pool instead of destroying and freeing it.
+///
+///	- Pool belongs to the thread which created it (e.g. thread_local object_pool<message>). Only that thread acquires.
+///	- Object is constructed once, by T(), and kept constructed while pooled. acquire() hands it out as it was returned:
+///	  reset what must not leak from the previous user. Control block is constructed anew on every acquire().
+///	- Release on the owner thread pushes to a plain free list. Release on another thread pushes to a lock-free return
+///	  stack (one CAS), which the owner takes whole (one exchange) when its free list is empty.
+///	- Objects returned while high_water are pooled already are destroyed (trimmed). trim() trims on demand.
+///	- Pool may be destroyed while its objects are in use. Their last releases destroy them.
+///	- With weak_ptrs an object returns with the last weak_ptr. No enable_shared_from_this and no ref_counted types.
+///
+namespace smart_ptr
+{
+
+/// What a pool did since it was created. Objects returned by another thread count when the owner takes them.
+struct object_pool_stats
+{
+	std::size_t pooled_{0};
+	std::size_t created_{0};
+	std::size_t acquired_{0};
+	/// Acquires served by a pooled object.
+	std::size_t recycled_{0};
+	std::size_t returned_{0};
+	/// Part of returned_ released by other threads.
+	std::size_t returned_remote_{0};
+	/// Destroyed above the high-water mark or by trim().
+	std::size_t trimmed_{0};
+};
+
+namespace detail
+{
+
+/// State of a pool which its objects point to. Outlives the pool until the last object is destroyed.
+template<typename T, typename Counting>
+class pool_heap
+{
+	using control_block = detail::control_block<Counting>;
+
+public:
+	/// Control block first, so the block is the address of its entry.
+	struct entry
+	{
+		alignas(control_block) unsigned char block_[sizeof(control_block)];
+		alignas(T) unsigned char object_[sizeof(T)];
+		entry* next_;
+		pool_heap* owner_;
+
+		[[nodiscard]] T* object() noexcept
+		{
+			return std::launder(reinterpret_cast<T*>(&object_));
+		}
+	};
+	static_assert(std::is_standard_layout_v<entry>);
+
+	const std::thread::id owner_thread_{std::this_thread::get_id()};
+	std::size_t high_water_;
+	/// Touched only by the owner thread.
+	entry* local_free_{nullptr};
+	object_pool_stats stats_;
+	bool closed_{false};
+	/// Objects returned by other threads. &closed_marker_ once the pool is destroyed.
+	std::atomic<entry*> returned_{nullptr};
+	/// One for the pool, one for every entry.
+	std::atomic<long> references_{1};
+
+	explicit pool_heap(const std::size_t high_water) noexcept
+		: high_water_(high_water)
+	{
+	}
+
+	entry* create_()
+	{
+		auto* created = new entry;
+		try
+		{
+			::new (static_cast<void*>(&created->object_)) T();
+		}
+		catch (...)
+		{
+			delete created;
+			throw;
+		}
+		created->owner_ = this;
+		references_.fetch_add(1, std::memory_order_relaxed);
+		++stats_.created_;
+		return created;
+	}
+
+	static void destroy_(entry* destroyed) noexcept
+	{
+		pool_heap* heap = destroyed->owner_;
+		std::destroy_at(destroyed->object());
+		delete destroyed;
+		heap->release_();
+	}
+
+	void release_() noexcept
+	{
+		if (references_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			delete this;
+		}
+	}
+
+	void push_local_(entry* pooled) noexcept
+	{
+		if (stats_.pooled_ >= high_water_)
+		{
+			++stats_.trimmed_;
+			destroy_(pooled);
+			return;
+		}
+		pooled->next_ = local_free_;
+		local_free_ = pooled;
+		++stats_.pooled_;
+	}
+
+	static inline entry closed_marker_{};
+
+	/// Owner takes everything other threads returned.
+	void take_returned_() noexcept
+	{
+		for (entry* taken = returned_.exchange(nullptr, std::memory_order_acquire); taken;)
+		{
+			entry* next = taken->next_;
+			++stats_.returned_;
+			++stats_.returned_remote_;
+			push_local_(taken);
+			taken = next;
+		}
+	}
+
+	static void destroy_list_(entry* list) noexcept
+	{
+		while (list)
+		{
+			entry* next = list->next_;
+			destroy_(list);
+			list = next;
+		}
+	}
+
+	/// Last release of an object (its last weak reference).
+	static void manage_(control_block* control, const typename control_block::action what) noexcept
+	{
+		if (what == control_block::action::destroy_payload)
+		{
+			// Object stays constructed for the next user.
+			return;
+		}
+		auto* returned = reinterpret_cast<entry*>(control);
+		std::destroy_at(control);
+		returned->owner_->give_back_(returned);
+	}
+
+	void give_back_(entry* returned) noexcept
+	{
+		if (std::this_thread::get_id() == owner_thread_ && !closed_)
+		{
+			++stats_.returned_;
+			push_local_(returned);
+			return;
+		}
+		// Closing swaps the marker into the same atomic, so a push is either taken by close_ or sees the marker.
+		// Nothing of the heap is touched after a successful push: the pool may be gone right after it.
+		entry* head = returned_.load(std::memory_order_relaxed);
+		do
+		{
+			if (head == &closed_marker_)
+			{
+				destroy_(returned);
+				return;
+			}
+			returned->next_ = head;
+		} while (!returned_.compare_exchange_weak(head, returned, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	/// Pool destroyed: pooled objects go now, objects in use with their last release.
+	void close_() noexcept
+	{
+		closed_ = true;
+		destroy_list_(std::exchange(local_free_, nullptr));
+		destroy_list_(returned_.exchange(&closed_marker_, std::memory_order_acquire));
+		release_();
+	}
+};
+
+}
+
+template<typename T, typename Counting = atomic_counting>
+class object_pool
+{
+	static_assert(!std::is_array_v<T> && !detail::is_ref_counted<T, Counting>, "object_pool recycles single objects with a separate control block");
+
+	using heap = detail::pool_heap<T, Counting>;
+	using control_block = detail::control_block<Counting>;
+
+	heap* heap_;
+
+public:
+	static constexpr std::size_t default_high_water = 1024;
+
+	explicit object_pool(const std::size_t high_water = default_high_water)
+		: heap_(new heap(high_water))
+	{
+	}
+
+	object_pool(const object_pool&) = delete;
+	object_pool& operator=(const object_pool&) = delete;
+
+	~object_pool()
+	{
+		heap_->close_();
+	}
+
+	/// Pooled object, or a new T() when none is pooled. No allocation when one is.
+	[[nodiscard]] shared_ptr<T, Counting> acquire()
+	{
+		assert(std::this_thread::get_id() == heap_->owner_thread_ && "object_pool used by a thread which does not own it");
+		if (!heap_->local_free_ && heap_->returned_.load(std::memory_order_relaxed))
+		{
+			heap_->take_returned_();
+		}
+		typename heap::entry* acquired = heap_->local_free_;
+		if (acquired)
+		{
+			heap_->local_free_ = acquired->next_;
+			--heap_->stats_.pooled_;
+			++heap_->stats_.recycled_;
+		}
+		else
+		{
+			acquired = heap_->create_();
+		}
+		++heap_->stats_.acquired_;
+		auto* control = ::new (static_cast<void*>(&acquired->block_)) control_block(acquired->object(), &heap::manage_);
+		return detail::shared_ptr_factory<T, Counting>::adopt(control);
+	}
+
+	/// Creates objects until count are pooled, so that the first acquires do not allocate.
+	void warm_up(const std::size_t count)
+	{
+		while (heap_->stats_.pooled_ < count)
+		{
+			typename heap::entry* created = heap_->create_();
+			created->next_ = heap_->local_free_;
+			heap_->local_free_ = created;
+			++heap_->stats_.pooled_;
+		}
+	}
+
+	/// Destroys pooled objects down to keep. Takes objects returned by other threads first.
+	void trim(const std::size_t keep = 0) noexcept
+	{
+		heap_->take_returned_();
+		while (heap_->stats_.pooled_ > keep)
+		{
+			typename heap::entry* trimmed = heap_->local_free_;
+			heap_->local_free_ = trimmed->next_;
+			--heap_->stats_.pooled_;
+			++heap_->stats_.trimmed_;
+			heap::destroy_(trimmed);
+		}
+	}
+
+	/// Objects returned above this many pooled are destroyed.
+	void set_high_water(const std::size_t high_water) noexcept
+	{
+		heap_->high_water_ = high_water;
+	}
+
+	[[nodiscard]] std::size_t high_water() const noexcept
+	{
+		return heap_->high_water_;
+	}
+
+	[[nodiscard]] object_pool_stats stats() const noexcept
+	{
+		return heap_->stats_;
+	}
+};
+
+}
@@ -0,0 +1,162 @@
+#include "catch.hpp"
+#include "alive_counter.h"
+#include "object_pool.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+struct pooled_message : alive_counter<pooled_message>
+{
+	std::string body_;
+	int uses_{0};
+
+	pooled_message() = default;
+	pooled_message(const pooled_message&) = delete;
+};
+}
+
+TEST_CASE("object_pool")
+{
+	SECTION("Last release returns the object and acquire recycles it")
+	{
+		{
+			smart_ptr::object_pool<pooled_message> pool;
+			const pooled_message* first{};
+			{
+				const auto message = pool.acquire();
+				message->body_ = "hello";
+				++message->uses_;
+				first = message.get();
+				const auto copy = message;
+				REQUIRE(message.use_count() == 2);
+			}
+			REQUIRE(pool.stats().pooled_ == 1);
+			REQUIRE(pooled_message::alive_ == 1);
+			const auto again = pool.acquire();
+			REQUIRE(again.get() == first);
+			REQUIRE(again->uses_ == 1);
+			REQUIRE(again.use_count() == 1);
+			const auto stats = pool.stats();
+			REQUIRE(stats.created_ == 1);
+			REQUIRE(stats.acquired_ == 2);
+			REQUIRE(stats.recycled_ == 1);
+			REQUIRE(stats.returned_ == 1);
+		}
+		REQUIRE(pooled_message::alive_ == 0);
+	}
+
+	SECTION("weak_ptr expires with the last shared_ptr, the object returns with the last weak_ptr")
+	{
+		smart_ptr::object_pool<pooled_message> pool;
+		auto message = pool.acquire();
+		auto observer = std::make_unique<smart_ptr::weak_ptr<pooled_message>>(message);
+		message.reset();
+		REQUIRE(observer->expired());
+		REQUIRE(!observer->lock());
+		REQUIRE(pool.stats().pooled_ == 0);
+		observer.reset();
+		REQUIRE(pool.stats().pooled_ == 1);
+	}
+
+	SECTION("Warm-up, high-water mark and trim")
+	{
+		{
+			smart_ptr::object_pool<pooled_message> pool(4);
+			pool.warm_up(3);
+			REQUIRE(pool.stats().created_ == 3);
+			std::vector<smart_ptr::shared_ptr<pooled_message>> in_use;
+			for (int i = 0; i < 6; ++i)
+			{
+				in_use.push_back(pool.acquire());
+			}
+			REQUIRE(pool.stats().recycled_ == 3);
+			REQUIRE(pool.stats().created_ == 6);
+			in_use.clear();
+			REQUIRE(pool.stats().pooled_ == 4);
+			REQUIRE(pool.stats().trimmed_ == 2);
+			REQUIRE(pooled_message::alive_ == 4);
+			pool.trim(1);
+			REQUIRE(pool.stats().pooled_ == 1);
+			REQUIRE(pooled_message::alive_ == 1);
+		}
+		REQUIRE(pooled_message::alive_ == 0);
+	}
+
+	SECTION("Objects in use outlive the pool")
+	{
+		smart_ptr::shared_ptr<pooled_message> kept;
+		{
+			smart_ptr::object_pool<pooled_message> pool;
+			kept = pool.acquire();
+			kept->body_ = "kept";
+		}
+		REQUIRE(kept->body_ == "kept");
+		kept.reset();
+		REQUIRE(pooled_message::alive_ == 0);
+	}
+}
+
+TEST_CASE("object_pool released by other threads")
+{
+	constexpr int consumers = 4;
+	constexpr int messages = 2'000;
+	SECTION("Every object is returned once")
+	{
+		{
+			smart_ptr::object_pool<pooled_message> pool(messages);
+			std::vector<smart_ptr::shared_ptr<pooled_message>> batch;
+			for (int i = 0; i < messages; ++i)
+			{
+				batch.push_back(pool.acquire());
+			}
+			std::vector<std::thread> threads;
+			for (int c = 0; c < consumers; ++c)
+			{
+				std::vector<smart_ptr::shared_ptr<pooled_message>> part;
+				for (int i = c; i < messages; i += consumers)
+				{
+					part.push_back(batch[i]);
+				}
+				threads.emplace_back([part = std::move(part)]() mutable { part.clear(); });
+			}
+			batch.clear();
+			for (auto& thread : threads)
+			{
+				thread.join();
+			}
+			// Every object is returned once: by the owner or by a consumer, whichever released it last.
+			pool.trim(messages);
+			const auto stats = pool.stats();
+			REQUIRE(stats.returned_ == messages);
+			REQUIRE(stats.pooled_ == messages);
+			REQUIRE(pool.acquire().get() != nullptr);
+			REQUIRE(pool.stats().created_ == messages);
+		}
+		REQUIRE(pooled_message::alive_ == 0);
+	}
+
+	SECTION("Pool destroyed while other threads still hold its objects")
+	{
+		std::vector<std::thread> threads;
+		{
+			smart_ptr::object_pool<pooled_message> pool;
+			for (int c = 0; c < consumers; ++c)
+			{
+				std::vector<smart_ptr::shared_ptr<pooled_message>> part;
+				for (int i = 0; i < 100; ++i)
+				{
+					part.push_back(pool.acquire());
+				}
+				threads.emplace_back([part = std::move(part)]() mutable { part.clear(); });
+			}
+		}
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+		REQUIRE(pooled_message::alive_ == 0);
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+#include "shared_ptr.h"
+
+/// Counting policy with strong and weak count packed into one 64 bit atomic word.
+///
+///	- Strong count in the low 32 bits, weak count in the high 32 bits. All strong references share one weak reference as usual.
+///	- Release of the last strong reference while no weak_ptr exists: one load sees strong and weak count equal to one.
+///	  Nobody else can reach the block, so it is destroyed without any RMW. Otherwise one fetch_sub, then one load
+///	  for the shared weak reference. With atomic_counting the same release costs two RMWs.
+///	- weak_ptr::lock and expired see both counts in one consistent snapshot.
+///
+namespace smart_ptr
+{
+
+template<template<typename> class Atomic = std::atomic>
+struct basic_packed_counting
+{
+	static constexpr std::uint64_t one_strong = 1;
+	static constexpr std::uint64_t one_weak = std::uint64_t{1} << 32;
+	static constexpr std::uint64_t strong_mask = one_weak - 1;
+
+	Atomic<std::uint64_t> counts_{one_strong | one_weak};
+
+	void add_strong() noexcept
+	{
+		counts_.fetch_add(one_strong, std::memory_order_relaxed);
+	}
+
+	bool try_add_strong() noexcept
+	{
+		std::uint64_t counts = counts_.load(std::memory_order_relaxed);
+		do
+		{
+			if ((counts & strong_mask) == 0)
+			{
+				return false;
+			}
+		} while (!counts_.compare_exchange_weak(counts, counts + one_strong, std::memory_order_acq_rel, std::memory_order_relaxed));
+		return true;
+	}
+
+	bool release_strong() noexcept
+	{
+		// Acquire: no RMW follows, the load alone must order the destruction after uses by former owners.
+		if (counts_.load(std::memory_order_acquire) == (one_strong | one_weak))
+		{
+			// Only owner, no weak_ptr. Relaxed store: nobody else can read the block any more.
+			counts_.store(one_weak, std::memory_order_relaxed);
+			return true;
+		}
+		return (counts_.fetch_sub(one_strong, std::memory_order_acq_rel) & strong_mask) == one_strong;
+	}
+
+	void add_weak() noexcept
+	{
+		counts_.fetch_add(one_weak, std::memory_order_relaxed);
+	}
+
+	bool release_weak() noexcept
+	{
+		// No strong reference and no other weak one. Nobody can add a reference.
+		if (counts_.load(std::memory_order_acquire) == one_weak)
+		{
+			return true;
+		}
+		return counts_.fetch_sub(one_weak, std::memory_order_acq_rel) == one_weak;
+	}
+
+	[[nodiscard]] long use_count() const noexcept
+	{
+		return static_cast<long>(counts_.load(std::memory_order_relaxed) & strong_mask);
+	}
+};
+
+using packed_counting = basic_packed_counting<>;
+
+template<typename T>
+using packed_shared_ptr = shared_ptr<T, packed_counting>;
+
+template<typename T>
+using packed_weak_ptr = weak_ptr<T, packed_counting>;
+
+template<typename T, typename... Args>
+packed_shared_ptr<T> make_packed_shared(Args&&... args)
+{
+	return make_shared<T, packed_counting>(std::forward<Args>(args)...);
+}
+
+}
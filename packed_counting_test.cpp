@@ -0,0 +1,83 @@
+#include "catch.hpp"
+#include "alive_counter.h"
+#include "packed_counting.h"
+
+#include <thread>
+#include <vector>
+
+namespace
+{
+struct packed_payload : alive_counter<packed_payload>
+{
+	int value_;
+
+	explicit packed_payload(const int value)
+		: value_(value)
+	{
+	}
+};
+}
+
+TEST_CASE("packed_shared_ptr")
+{
+	SECTION("Only owner releases")
+	{
+		auto shared = smart_ptr::make_packed_shared<packed_payload>(1);
+		REQUIRE(shared.use_count() == 1);
+		shared = smart_ptr::packed_shared_ptr<packed_payload>{};
+		REQUIRE(packed_payload::alive_ == 0);
+	}
+
+	SECTION("Copies")
+	{
+		auto shared = smart_ptr::make_packed_shared<packed_payload>(2);
+		{
+			const auto copy{shared};  // NOLINT(performance-unnecessary-copy-initialization) // The copy is intentional.
+			REQUIRE(shared.use_count() == 2);
+		}
+		REQUIRE(shared.use_count() == 1);
+		REQUIRE(shared->value_ == 2);
+	}
+
+	SECTION("weak_ptr outlives the object")
+	{
+		auto shared = smart_ptr::make_packed_shared<packed_payload>(3);
+		smart_ptr::packed_weak_ptr<packed_payload> weak(shared);
+		smart_ptr::packed_weak_ptr<packed_payload> second(weak);
+		REQUIRE(weak.lock()->value_ == 3);
+		shared = smart_ptr::packed_shared_ptr<packed_payload>{};
+		REQUIRE(packed_payload::alive_ == 0);
+		REQUIRE(weak.expired());
+		REQUIRE(!second.lock());
+	}
+
+	SECTION("Separately allocated payload")
+	{
+		const smart_ptr::packed_shared_ptr<packed_payload> shared(new packed_payload(4));
+		REQUIRE(shared.use_count() == 1);
+	}
+	REQUIRE(packed_payload::alive_ == 0);
+}
+
+TEST_CASE("packed_shared_ptr lock racing release")
+{
+	constexpr int iterations = 2'000;
+	std::atomic<bool> wrong_value{false};
+	for (int i = 0; i < iterations; ++i)
+	{
+		auto shared = smart_ptr::make_packed_shared<packed_payload>(i);
+		smart_ptr::packed_weak_ptr<packed_payload> weak(shared);
+		std::thread locker([&weak, &wrong_value, i]
+		{
+			const auto locked = weak.lock();
+			if (locked && locked->value_ != i)
+			{
+				wrong_value = true;
+			}
+		});
+		shared = smart_ptr::packed_shared_ptr<packed_payload>{};
+		locker.join();
+	}
+	REQUIRE(!wrong_value);
+	REQUIRE(packed_payload::alive_ == 0);
+}
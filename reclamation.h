@@ -0,0 +1,113 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+/// Bookkeeping shared by the deferred reclamation domains (epoch_domain, hazard_domain).
+///
+///	- Per thread records in a lock-free list. Records are never freed, a record released by a finished thread
+///	  is reused by a new one. Record needs in_use_ (true when created) and next_.
+///	- Retired objects left by a finished thread (or retired by it during its teardown) are orphans.
+///	  They are taken over by the next reclamation of any thread.
+///
+namespace smart_ptr
+{
+namespace detail
+{
+
+/// Never destroyed. Threads may retire while static objects are being destroyed.
+template<typename Domain>
+Domain& immortal_instance()
+{
+	static auto* domain = new Domain;
+	return *domain;
+}
+
+template<typename Record, typename Retired>
+class record_registry
+{
+	std::atomic<Record*> head_{nullptr};
+	std::atomic<int> record_count_{0};
+	std::mutex orphans_mutex_;
+	std::vector<Retired> orphans_;
+	static inline thread_local bool finished_{false};
+
+public:
+	/// Thread local state of this thread is destroyed. Retired objects go to orphans from now on.
+	[[nodiscard]] static bool finished() noexcept
+	{
+		return finished_;
+	}
+
+	[[nodiscard]] Record* head() const noexcept
+	{
+		return head_.load(std::memory_order_acquire);
+	}
+
+	[[nodiscard]] int record_count() const noexcept
+	{
+		return record_count_.load(std::memory_order_relaxed);
+	}
+
+	/// Reuses a released record or adds a new one.
+	Record* acquire()
+	{
+		for (Record* rec = head(); rec; rec = rec->next_)
+		{
+			bool free = false;
+			if (!rec->in_use_.load(std::memory_order_relaxed) && rec->in_use_.compare_exchange_strong(free, true, std::memory_order_acquire))
+			{
+				return rec;
+			}
+		}
+		auto* rec = new Record;
+		rec->next_ = head_.load(std::memory_order_relaxed);
+		while (!head_.compare_exchange_weak(rec->next_, rec, std::memory_order_release, std::memory_order_relaxed))
+		{
+		}
+		++record_count_;
+		return rec;
+	}
+
+	static void release(Record* rec) noexcept
+	{
+		rec->in_use_.store(false, std::memory_order_release);
+	}
+
+	void orphan(const Retired& item)
+	{
+		std::lock_guard lock(orphans_mutex_);
+		orphans_.push_back(item);
+	}
+
+	/// Called by the thread local state of this thread when it is destroyed.
+	void finish_thread(const std::vector<Retired>& list)
+	{
+		finished_ = true;
+		if (!list.empty())
+		{
+			std::lock_guard lock(orphans_mutex_);
+			orphans_.insert(orphans_.end(), list.begin(), list.end());
+		}
+	}
+
+	/// Takes list and the orphans (unless another thread is taking them just now) for reclamation.
+	/// Reclaimer may retire more objects, so the list is detached first.
+	[[nodiscard]] std::vector<Retired> detach(std::vector<Retired>& list)
+	{
+		{
+			std::unique_lock lock(orphans_mutex_, std::try_to_lock);
+			if (lock.owns_lock() && !orphans_.empty())
+			{
+				list.insert(list.end(), orphans_.begin(), orphans_.end());
+				orphans_.clear();
+			}
+		}
+		std::vector<Retired> candidates;
+		candidates.swap(list);
+		return candidates;
+	}
+};
+
+}
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "shared_ptr.h"
+
+/// Counting policy for a few globally hot objects: strong count split into shards, one cache line each.
+///
+///	- Copy is counted on the shard of the copying thread, release on the shard the reference was counted on.
+///	  shared_ptr keeps the shard in its ticket_, one word more.
+///	- Zero detection as a two level scalable non-zero indicator: root_ counts shards with non-zero count plus
+///	  references counted on the root directly (the one make_shared creates and those weak_ptr::lock creates).
+///	  Shard going from 0 to 1 adds one to root_, going from 1 to 0 removes it. Whoever brings root_ to zero
+///	  released the last reference, exactly once.
+///	- root_ cannot be zero while a shard turns non-zero: the copying thread holds another reference, counted
+///	  on the root or on a shard which holds the root. So zero is final and weak_ptr::lock is a CAS on root_.
+///	- Only shard counts change while a thread holds a reference of its own: keep one copy per thread
+///	  (thread_local, or a member of a per-thread worker). Otherwise each copy and release touches root_ as well.
+///	- Control block has Shards + 3 cache lines (2240 bytes with 32 shards). weak_ptr traffic is counted as in atomic_counting.
+///
+namespace smart_ptr
+{
+
+namespace detail
+{
+/// Threads get consecutive numbers on first use. Shard is the number modulo shard count.
+struct thread_shard
+{
+	static std::size_t index() noexcept
+	{
+		static std::atomic<std::size_t> next{0};
+		thread_local const std::size_t mine = next.fetch_add(1, std::memory_order_relaxed);
+		return mine;
+	}
+};
+}
+
+/// ShardOf::index() numbers the calling thread. Tests replace it to get the same shard for a thread in every run.
+template<template<typename> class Atomic = std::atomic, std::size_t Shards = 32, typename ShardOf = detail::thread_shard>
+struct basic_sharded_counting
+{
+	static_assert(Shards > 0);
+
+	/// 0 is the root, shard i is i + 1. Default ticket is the root, where the first reference is counted.
+	using ticket = std::uint32_t;
+
+	struct alignas(detail::cache_line_size) counter
+	{
+		Atomic<long> count_{0};
+	};
+
+	counter root_{1};
+	counter shards_[Shards];
+	alignas(detail::cache_line_size) Atomic<int> weak_usages_{1};
+
+	ticket add_strong() noexcept
+	{
+		const auto shard = static_cast<ticket>(ShardOf::index() % Shards);
+		if (shards_[shard].count_.fetch_add(1, std::memory_order_relaxed) == 0)
+		{
+			// Caller holds another reference, root_ is not zero.
+			root_.count_.fetch_add(1, std::memory_order_relaxed);
+		}
+		return shard + 1;
+	}
+
+	bool try_add_strong(ticket& counted_on) noexcept
+	{
+		long count = root_.count_.load(std::memory_order_relaxed);
+		do
+		{
+			if (count == 0)
+			{
+				return false;
+			}
+		} while (!root_.count_.compare_exchange_weak(count, count + 1, std::memory_order_acq_rel, std::memory_order_relaxed));
+		counted_on = 0;
+		return true;
+	}
+
+	bool release_strong(const ticket counted_on) noexcept
+	{
+		// Acq_rel on the shard: release by the owner bringing it to zero orders all former releases of the shard.
+		if (counted_on != 0 && shards_[counted_on - 1].count_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		{
+			return false;
+		}
+		return root_.count_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+	}
+
+	void add_weak() noexcept
+	{
+		weak_usages_.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	bool release_weak() noexcept
+	{
+		return weak_usages_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+	}
+
+	/// Exact when no reference is being copied or released concurrently. Zero is always exact.
+	[[nodiscard]] long use_count() const noexcept
+	{
+		const long root = root_.count_.load(std::memory_order_relaxed);
+		if (root == 0)
+		{
+			return 0;
+		}
+		long count = root;
+		for (const counter& shard : shards_)
+		{
+			if (const long in_shard = shard.count_.load(std::memory_order_relaxed); in_shard != 0)
+			{
+				// Shard holds one count of the root itself.
+				count += in_shard - 1;
+			}
+		}
+		return count > 0 ? count : 1;
+	}
+};
+
+using sharded_counting = basic_sharded_counting<>;
+
+template<typename T>
+using sharded_shared_ptr = shared_ptr<T, sharded_counting>;
+
+template<typename T>
+using sharded_weak_ptr = weak_ptr<T, sharded_counting>;
+
+template<typename T, typename... Args>
+sharded_shared_ptr<T> make_sharded_shared(Args&&... args)
+{
+	return make_shared<T, sharded_counting>(std::forward<Args>(args)...);
+}
+
+}
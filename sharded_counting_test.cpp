@@ -0,0 +1,125 @@
+#include "catch.hpp"
+#include "alive_counter.h"
+#include "sharded_counting.h"
+
+#include <thread>
+#include <vector>
+
+namespace
+{
+struct sharded_payload : alive_counter<sharded_payload>
+{
+	int value_;
+
+	explicit sharded_payload(const int value)
+		: value_(value)
+	{
+	}
+};
+}
+
+TEST_CASE("sharded_shared_ptr")
+{
+	static_assert(sizeof(smart_ptr::shared_ptr<int>) == 2 * sizeof(void*), "Policies without ticket add nothing to shared_ptr");
+	static_assert(sizeof(smart_ptr::sharded_shared_ptr<int>) == 3 * sizeof(void*));
+
+	SECTION("Only owner releases")
+	{
+		auto shared = smart_ptr::make_sharded_shared<sharded_payload>(1);
+		REQUIRE(shared.use_count() == 1);
+		shared.reset();
+		REQUIRE(sharded_payload::alive_ == 0);
+	}
+
+	SECTION("Copies are counted on the shard of the thread")
+	{
+		auto shared = smart_ptr::make_sharded_shared<sharded_payload>(2);
+		{
+			const auto copy{shared};  // NOLINT(performance-unnecessary-copy-initialization) // The copy is intentional.
+			const auto second{copy};  // NOLINT(performance-unnecessary-copy-initialization) // The copy is intentional.
+			REQUIRE(shared.use_count() == 3);
+		}
+		REQUIRE(shared.use_count() == 1);
+		// First reference released while a copy lives on a shard.
+		auto copy = shared;
+		shared.reset();
+		REQUIRE(sharded_payload::alive_ == 1);
+		REQUIRE(copy.use_count() == 1);
+		REQUIRE(copy->value_ == 2);
+	}
+
+	SECTION("Moves keep the ticket")
+	{
+		auto shared = smart_ptr::make_sharded_shared<sharded_payload>(3);
+		auto copy = shared;
+		auto moved = std::move(copy);
+		smart_ptr::sharded_shared_ptr<sharded_payload> assigned;
+		assigned = std::move(shared);
+		REQUIRE(moved.use_count() == 2);
+		moved.reset();
+		REQUIRE(assigned.use_count() == 1);
+	}
+
+	SECTION("shared_view shares on the shard of the thread")
+	{
+		auto shared = smart_ptr::make_sharded_shared<sharded_payload>(5);
+		const smart_ptr::shared_view<sharded_payload, smart_ptr::sharded_counting> view = shared;
+		auto kept = view.share();
+		shared.reset();
+		REQUIRE(kept.use_count() == 1);
+		REQUIRE(kept->value_ == 5);
+	}
+
+	SECTION("weak_ptr outlives the object")
+	{
+		auto shared = smart_ptr::make_sharded_shared<sharded_payload>(4);
+		smart_ptr::sharded_weak_ptr<sharded_payload> weak(shared);
+		auto locked = weak.lock();
+		REQUIRE(locked->value_ == 4);
+		REQUIRE(shared.use_count() == 2);
+		shared.reset();
+		REQUIRE(!weak.expired());
+		locked.reset();
+		REQUIRE(sharded_payload::alive_ == 0);
+		REQUIRE(weak.expired());
+		REQUIRE(!weak.lock());
+	}
+	REQUIRE(sharded_payload::alive_ == 0);
+}
+
+TEST_CASE("sharded_shared_ptr copied on many threads")
+{
+	constexpr int threads = 8;
+	constexpr int copies = 20'000;
+	for (int round = 0; round < 20; ++round)
+	{
+		auto shared = smart_ptr::make_sharded_shared<sharded_payload>(round);
+		smart_ptr::sharded_weak_ptr<sharded_payload> weak(shared);
+		std::atomic<bool> wrong_value{false};
+		std::vector<std::thread> workers;
+		for (int i = 0; i < threads; ++i)
+		{
+			// Every worker releases its last reference itself, some of them after the main thread released its own.
+			workers.emplace_back([copy = shared, &weak, &wrong_value, round]() mutable
+			{
+				for (int j = 0; j < copies; ++j)
+				{
+					const auto another = j % 2 == 0 ? copy : weak.lock();
+					if (another->value_ != round)
+					{
+						wrong_value = true;
+					}
+				}
+				copy.reset();
+			});
+		}
+		shared.reset();
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+		REQUIRE(!wrong_value);
+		REQUIRE(sharded_payload::alive_ == 0);
+		REQUIRE(weak.expired());
+	}
+}
@@ -1,5 +1,25 @@
 ﻿#pragma once
+#include <algorithm>
 #include <atomic>
+#include <cassert>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/// MSVC accepts [[no_unique_address]] but ignores it (ABI compatibility). Empty members take space there unless
+/// they carry its own attribute.
+#if defined(_MSC_VER)
+#define SMART_PTR_NO_UNIQUE_ADDRESS [[msvc::no_unique_address]]
+#else
+#define SMART_PTR_NO_UNIQUE_ADDRESS [[no_unique_address]]
+#endif
 
 /// Lock free smart ptr similar to shared ptr.
 ///	- Destructor of pointed object must not throw. Or operators =, == have undefined behavior.
@@ -7,257 +27,1664 @@
 ///
 ///	Formatting: Using sneak_case as stl. This sample takes method signatures from stl, so does casing.
 ///
+/// Counting policy:
+///	- Second template parameter chooses how the control block counts references. It is the base of the control block.
+///	- atomic_counting (default): two std::atomic<int>.
+///	- local_counting: two plain ints. For objects which never leave one thread (local_shared_ptr).
+///	- packed_counting (packed_counting.h): both counts in one 64 bit atomic.
+///	- padded_counting: like atomic_counting, strong count, weak count and payload pointer on separate cache lines.
+///	- sharded_counting (sharded_counting.h): strong count split into per-thread shards.
+///	  Policy with member type ticket tells every shared_ptr which counter its reference was counted on.
+///	- biased_counting (biased_counting.h): owner thread counts without atomic instructions.
+///
+/// Layout: shared_ptr is the control block pointer and the pointer get() returns, 16 bytes as std::shared_ptr.
+///	get(), * and -> load only the latter, counting touches only the control block (bench/layout_bench).
+///
+/// ref_counted: base of types which carry their own counters. shared_ptr to them allocates no control block.
+///
+/// shared_view: borrowed pointer to an object owned by a shared_ptr, for parameters. Copies do not count.
+///	Define SMART_PTR_CHECKED_VIEWS to make shared_view check on every access that its object is still alive.
+///
 /// Known limits:
-///	- Owned object is not part of control block.
-/// - No custom deleter or allocator.
-///	- No separate template type for constructors. (std::shared_ptr constructor has another template type Y)
-///	- No make_shared function.
-///	- No std::hash<std::shared_ptr>
-///	- No std::atomic<std::shared_ptr>
-///	- No enable_shared_from_this
+///	- Owned object is part of control block only when created by make_shared, make_shared_for_overwrite or allocate_shared.
+///	- shared_ptr<T[]> and shared_ptr<T[N]> own arrays. make_shared<T[]>(n) puts the elements right after the counters.
+/// - Custom deleter and allocator for shared_ptr(T*, Deleter, Alloc) are stored inline in the control block. No get_deleter.
+///	- No std::atomic<std::shared_ptr>. Use smart_ptr::atomic_shared_ptr (atomic_shared_ptr.h).
 ///
 /// Omitted (not much to learn in implementing them IMHO)
 /// - reset
 ///	- swap
-///	- operator[] managing arrays not implemented at all.
 ///	- unique as it's removed in C++ 20
-///	- owner_before
 /// - operator<<(std::shared_ptr)
 ///
 namespace smart_ptr
 {
 
-template<typename T>
-class weak_ptr;
+namespace detail
+{
+#if defined(__cpp_lib_hardware_interference_size) && !defined(__GNUC__)
+inline constexpr std::size_t cache_line_size = std::hardware_destructive_interference_size;
+#else
+/// GCC warns that its std::hardware_destructive_interference_size may change with compiler version or -mtune.
+/// Layout of the control block must not.
+inline constexpr std::size_t cache_line_size = 64;
+#endif
 
-template<typename T>
-class shared_ptr
+/// Misuse which would otherwise silently corrupt counts or hand out the wrong object. Checked in release builds too.
+[[noreturn]] inline void fatal(const char* message) noexcept
 {
-	friend class weak_ptr<T>;
+	std::fputs(message, stderr);
+	std::abort();
+}
 
-	struct control_block
-	{
-		explicit control_block(T* payload)
-			: payload_(payload)
-		{
-		}
+template<typename Counting>
+struct control_block;
 
-		std::atomic<int> usages_{1};
-		/// Control block is always created by a shared ptr. Now weak_ptr alone can create control_block.
-		/// All shared pointers collectively have one weak pointer so they keep control block "alive".
-		std::atomic<int> weak_usages_{1}; 
-		T* payload_{nullptr};
-	};
+template<typename Counting>
+void finish_weak(control_block<Counting>* control) noexcept;
+}
 
-	control_block* control_{nullptr};
+/// Default counting policy. Strong and weak count are two separate atomic ints.
+///
+/// Every counting policy provides the same members. Block starts with one strong reference
+/// and one weak reference which all strong references share.
+///	- add_strong, add_weak: caller already holds a reference keeping the block alive.
+///	- try_add_strong: for weak_ptr. Fails once the strong count has dropped to zero.
+///	- release_strong, release_weak: true when the caller has released the last one.
+///	- use_count: informative only.
+/// Atomic is a template parameter so benchmarks and tests can count or check every atomic operation.
+/// Alignment of each counter is a template parameter for padded_counting.
+/// Memory orders are checked by model_checker_test.cpp against every interleaving of copy, destroy, lock and weak_ptr destroy.
+///
+/// Strong count is a sticky counter, so weak_ptr::lock is one fetch_add (wait-free, bounded time):
+///	- Last release brings the count to 0 and then sets zero_flag by CAS from exactly 0. Set, the count is zero
+///	  forever: lock adds one, sees the flag, fails and takes its one back.
+///	- Lock between the two steps sees no flag and revives the count from 0 to 1. CAS of the releaser fails, the object
+///	  lives on and the reviver is an owner now. Losing releaser has no reference left, so the reviver adds a weak
+///	  reference for it and the loser releases that one after its CAS. Each revival has exactly one such loser.
+///	- use_count reading plain 0 sets zero_flag | zero_pending itself, so expired() never turns false again.
+///	  Releaser whose CAS finds zero_pending takes it away and destroys the object. Only one of them can.
+///	- Flags leave 2^29 - 1 strong references (max_usages). Batches paid in advance (atomic_shared_ptr) check it.
+template<template<typename> class Atomic = std::atomic, std::size_t Alignment = alignof(Atomic<int>)>
+struct basic_atomic_counting
+{
+	static constexpr int zero_flag = 1 << 30;
+	static constexpr int zero_pending = 1 << 29;
+	static constexpr int max_usages = zero_pending - 1;
 
-	void finish_one_instance_()
+	alignas(Alignment) Atomic<int> usages_{1};
+	/// Control block is always created by a shared ptr. Now weak_ptr alone can create control_block.
+	/// All shared pointers collectively have one weak pointer so they keep control block "alive".
+	alignas(Alignment) Atomic<int> weak_usages_{1};
+
+	/// New reference is made from an existing one, so there is nothing to order. Relaxed.
+	void add_strong() noexcept
+	{
+		usages_.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/// Increment if not zero. No loop: one fetch_add, and one more atomic operation when it fails or revives.
+	bool try_add_strong() noexcept
 	{
-		if (!control_)
+		const int usages = usages_.fetch_add(1, std::memory_order_acq_rel);
+		if ((usages & zero_flag) != 0)
 		{
-			return;
+			// Keeps failed locks from carrying into the flags.
+			usages_.fetch_sub(1, std::memory_order_relaxed);
+			return false;
 		}
-		if (--control_->usages_ == 0)
+		if (usages == 0)
 		{
-			// Last strong owner.
-			// There might still be another (thread with) std::weak_ptr pointing to our control_block.
-			delete control_->payload_;
-			if (--control_->weak_usages_ == 0)
-			{
-				delete control_;
-			}
+			// Weak reference of the releaser which brought the count to zero and is going to lose its CAS.
+			weak_usages_.fetch_add(1, std::memory_order_relaxed);
 		}
+		return true;
 	}
 
-	friend void swap(shared_ptr& lhs, shared_ptr& rhs) noexcept
+	/// Release: uses of the payload by this owner are done. Acquire: the last owner destroys it after all of them.
+	bool release_strong() noexcept
 	{
-		std::swap(lhs.control_, rhs.control_);
+		if (usages_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		{
+			return false;
+		}
+		int usages = 0;
+		if (usages_.compare_exchange_strong(usages, zero_flag, std::memory_order_acq_rel, std::memory_order_relaxed))
+		{
+			return true;
+		}
+		// use_count saw the zero first and left zero_pending to one of the releasers.
+		if ((usages & zero_pending) != 0 && (usages_.fetch_and(~zero_pending, std::memory_order_acq_rel) & zero_pending) != 0)
+		{
+			return true;
+		}
+		// Lost to a revival. Its weak reference has kept the block alive up to here.
+		if (release_weak())
+		{
+			detail::finish_weak(static_cast<detail::control_block<basic_atomic_counting>*>(this));
+		}
+		return false;
 	}
 
-public:
-	constexpr shared_ptr() noexcept = default;
-
-	constexpr explicit shared_ptr(nullptr_t) noexcept{}
-
-	explicit shared_ptr(T* ptr)
-	try
-		: control_(ptr ? new control_block(ptr) : nullptr)
+	void add_weak() noexcept
 	{
+		weak_usages_.fetch_add(1, std::memory_order_relaxed);
 	}
-	catch(const std::bad_alloc&)
+
+	bool release_weak() noexcept
 	{
-		delete ptr;
-		throw;
+		return weak_usages_.fetch_sub(1, std::memory_order_acq_rel) == 1;
 	}
 
-	explicit shared_ptr(std::unique_ptr<T, std::default_delete<T>>&& ptr)
-		: control_(new control_block(ptr.release()))
+	/// Not const: a zero it reads is made final.
+	[[nodiscard]] long use_count() noexcept
 	{
+		int usages = usages_.load(std::memory_order_relaxed);
+		if (usages == 0 && usages_.compare_exchange_strong(usages, zero_flag | zero_pending, std::memory_order_relaxed, std::memory_order_relaxed))
+		{
+			return 0;
+		}
+		return (usages & zero_flag) != 0 ? 0 : usages;
 	}
+};
 
-	~shared_ptr() noexcept
+using atomic_counting = basic_atomic_counting<>;
+
+/// Counters on separate cache lines, rest of the control block (payload pointer) on the third one.
+/// For objects whose strong and weak count are both hot: weak_ptr traffic does not slow down strong owners.
+/// Control block grows from 24 to 192 bytes and is not pooled by pool_allocator (over-aligned).
+using padded_counting = basic_atomic_counting<std::atomic, detail::cache_line_size>;
+
+/// Same as atomic_counting with plain ints. Object and all pointers to it must be used by one thread at a time.
+struct local_counting
+{
+	int usages_{1};
+	int weak_usages_{1};
+
+	void add_strong() noexcept
 	{
-		finish_one_instance_();
+		++usages_;
 	}
 
-	shared_ptr(const shared_ptr& other) noexcept
-		: control_{other.control_}
+	bool try_add_strong() noexcept
 	{
-		if(other)
+		if (usages_ == 0)
 		{
-			// here at least one valid shared ptr exists. No need to check usages_ for zero.
-			++control_->usages_;
+			return false;
 		}
+		++usages_;
+		return true;
 	}
 
-	shared_ptr(shared_ptr&& other) noexcept
+	bool release_strong() noexcept
 	{
-		std::swap(control_, other.control_);
+		return --usages_ == 0;
 	}
 
-	template< class Y >
-	explicit shared_ptr( const weak_ptr<Y>& r )
-		: control_(r.control_)
+	void add_weak() noexcept
 	{
-		int usages = control_->usages_.load();
-		do{
-			if (usages == 0)
-			{
-				throw std::bad_weak_ptr{};
-			}
-		} while(control_->usages_.compare_exchange_weak(usages, 1 + usages));
+		++weak_usages_;
 	}
 
-	// This = operator works for both l-value and r-value.
-	shared_ptr& operator=(shared_ptr<T> other) noexcept
+	bool release_weak() noexcept
 	{
-		using std::swap;
-		swap(*this, other); 
-		return *this;
+		return --weak_usages_ == 0;
 	}
 
-	friend bool operator==(const shared_ptr& lhs, const shared_ptr& rhs)
+	[[nodiscard]] long use_count() const noexcept
 	{
-		return lhs.get() == rhs.get();
+		return usages_;
 	}
+};
 
-	friend bool operator!=(const shared_ptr& lhs, const shared_ptr& rhs)
+template<typename T, typename Counting = atomic_counting>
+class weak_ptr;
+
+template<typename T, typename Counting = atomic_counting>
+class shared_ptr;
+
+template<typename T, typename Counting, bool Checked>
+class basic_shared_view;
+
+template<typename T, typename Counting = atomic_counting>
+class enable_shared_from_this;
+
+template<typename Counting = atomic_counting, bool Weak = true>
+class ref_counted;
+
+template<typename T>
+class atomic_shared_ptr;
+
+template<typename T>
+class hazard_shared_slot;
+
+template<typename T>
+class snapshot;
+
+namespace detail
+{
+template<typename T>
+struct epoch_payload;
+
+template<typename T, typename Counting>
+struct shared_ptr_factory;
+
+/// ref_counted<Counting, Weak> base of T, void when T carries no counters of Counting.
+template<typename Counting, bool Weak>
+ref_counted<Counting, Weak>* ref_counted_base(ref_counted<Counting, Weak>*);
+
+template<typename Counting>
+void ref_counted_base(...);
+
+template<typename T, typename Counting>
+using ref_counted_base_t = std::remove_pointer_t<decltype(ref_counted_base<Counting>(static_cast<std::remove_cv_t<T>*>(nullptr)))>;
+
+template<typename T, typename Counting>
+inline constexpr bool is_ref_counted = !std::is_void_v<ref_counted_base_t<T, Counting>>;
+
+/// Part of every control block which does not depend on T. Counting policy is the base,
+/// so policy code which only has the counters (e.g. a queue of biased_counting) can get back to the block.
+template<typename Counting>
+struct control_block : Counting
+{
+	/// The two things which differ between a separately allocated payload and a payload living inside the block.
+	enum class action
+	{
+		destroy_payload,
+		free_block,
+	};
+	/// Single function pointer instead of virtual methods. Control block stays a plain struct.
+	using manager = void (*)(control_block*, action) noexcept;
+
+	control_block(void* payload, const manager manage)
+		: payload_(payload)
+		, manage_(manage)
 	{
-		return !(lhs == rhs);
 	}
 
-	[[nodiscard]] explicit operator bool() const noexcept
+	/// Over-aligned policy (padded_counting) keeps the rest of the block on a cache line of its own.
+	/// The ABI could otherwise place payload_ into tail padding of the counters.
+	alignas(Counting) alignas(void*) void* payload_{nullptr};
+	manager manage_;
+};
+
+/// Which counter a strong reference is counted on. Only policies with member type ticket (sharded_counting) need one.
+struct no_ticket
+{
+};
+
+template<typename Counting>
+struct ticket_of
+{
+	using type = no_ticket;
+};
+
+template<typename Counting>
+	requires requires { typename Counting::ticket; }
+struct ticket_of<Counting>
+{
+	using type = typename Counting::ticket;
+};
+
+template<typename Counting>
+using ticket_t = typename ticket_of<Counting>::type;
+
+template<typename Counting>
+inline constexpr bool has_ticket = !std::is_same_v<ticket_t<Counting>, no_ticket>;
+
+template<typename Counting>
+ticket_t<Counting> add_strong(control_block<Counting>* control) noexcept
+{
+	if constexpr (has_ticket<Counting>)
 	{
-		return static_cast<bool>(control_);
+		return control->add_strong();
 	}
-	
-	void reset() noexcept 
+	else
 	{
-		finish_one_instance_();
-		control_->payload_ = nullptr;
+		control->add_strong();
+		return {};
 	}
+}
 
-	[[nodiscard]] T* get() const noexcept
+template<typename Counting>
+bool try_add_strong(control_block<Counting>* control, ticket_t<Counting>& ticket) noexcept
+{
+	if constexpr (has_ticket<Counting>)
 	{
-		return control_ ? control_->payload_ : nullptr;
+		return control->try_add_strong(ticket);
 	}
-
-	[[nodiscard]] T& operator*() const noexcept
+	else
 	{
-		return *get();
+		return control->try_add_strong();
 	}
+}
 
-	[[nodiscard]] T* operator->() const noexcept
+template<typename Counting>
+bool release_strong(control_block<Counting>* control, const ticket_t<Counting> ticket) noexcept
+{
+	if constexpr (has_ticket<Counting>)
 	{
-		return get();
+		return control->release_strong(ticket);
 	}
-
-	[[nodiscard]] long use_count() const noexcept
+	else
 	{
-		return control_ ? control_->usages_.load() : 0;
+		return control->release_strong();
 	}
+}
 
-};
-
-template< class T, class U >
-std::strong_ordering operator<=>( const shared_ptr<T>& lhs, const shared_ptr<U>& rhs ) noexcept
+/// Caller has released the last weak reference.
+template<typename Counting>
+void finish_weak(control_block<Counting>* control) noexcept
 {
-	return lhs.control_ <=> rhs.control_;
-};
+	control->manage_(control, control_block<Counting>::action::free_block);
+}
 
-template<typename T>
-class weak_ptr
+/// Caller has released the last strong reference.
+/// There might still be another (thread with) weak_ptr pointing to the control block.
+template<typename Counting>
+void finish_strong(control_block<Counting>* control) noexcept
 {
-	friend class shared_ptr<T>;
+	control->manage_(control, control_block<Counting>::action::destroy_payload);
+	if (control->release_weak())
+	{
+		finish_weak(control);
+	}
+}
+}
+
+template<typename T, typename Counting = atomic_counting, typename Alloc, typename... Args>
+shared_ptr<T, Counting> allocate_shared(const Alloc& alloc, Args&&... args);
 
-	typename shared_ptr<T>::control_block* control_{nullptr};
+template<typename T, typename Counting>
+class shared_ptr
+{
+	template<typename U, typename C>
+	friend class shared_ptr;
+	template<typename U, typename C>
+	friend class weak_ptr;
+	template<typename U, typename C, bool Checked>
+	friend class basic_shared_view;
+	template<typename U, typename C>
+	friend class enable_shared_from_this;
+	template<typename C, bool Weak>
+	friend class ref_counted;
+	friend class atomic_shared_ptr<T>;
+	friend class hazard_shared_slot<T>;
+	friend class snapshot<std::remove_cv_t<T>>;
+	friend struct detail::epoch_payload<T>;
+	friend struct detail::shared_ptr_factory<T, Counting>;
 
 public:
-	friend void swap(weak_ptr& lhs, weak_ptr& rhs) noexcept
+	/// T, or type of the elements when T is an array.
+	using element_type = std::remove_extent_t<T>;
+
+private:
+	using control_block = detail::control_block<Counting>;
+
+	/// delete or delete[]. Bounded arrays too: std::default_delete<T[N]> does not take element_type*.
+	using default_deleter_ = std::default_delete<std::conditional_t<std::is_array_v<T>, element_type[], T>>;
+	/// Allocator of the control block only. Not of const T, std::allocator<const T> is ill-formed.
+	using default_allocator_ = std::allocator<std::remove_cv_t<element_type>>;
+
+	/// T derives from ref_counted<Counting>: its own counters are the control block.
+	static constexpr bool intrusive_ = detail::is_ref_counted<T, Counting>;
+
+	/// Payload allocated by the caller (shared_ptr(T*) and shared_ptr(unique_ptr)).
+	static void manage_separate_(control_block* control, const typename control_block::action what) noexcept
 	{
-		std::swap(lhs.control_, rhs.control_);
+		if (what == control_block::action::destroy_payload)
+		{
+			default_deleter_{}(static_cast<element_type*>(control->payload_));
+		}
+		else
+		{
+			delete control;
+		}
 	}
 
-	constexpr weak_ptr() noexcept = default;
+	/// shared_ptr(Y*): deletes the object as the type it was created with. Keeps that pointer itself, a virtual base
+	/// cannot be cast back to Y.
+	template<typename Y>
+	struct derived_deleter_
+	{
+		Y* object_;
 
-	~weak_ptr()
+		void operator()(element_type*) const noexcept
+		{
+			delete object_;
+		}
+	};
+
+	/// Virtual destructor of T deletes Y right, plain control block is enough.
+	template<typename Y>
+	static auto deleter_for_(Y* ptr) noexcept
 	{
-		if (control_)
+		if constexpr (std::has_virtual_destructor_v<T>)
+		{
+			return default_deleter_{};
+		}
+		else
+		{
+			return derived_deleter_<Y>{ptr};
+		}
+	}
+
+	/// Payload constructed in place right after the counters. One allocation, one free.
+	template<typename Alloc>
+	struct inplace_control_block : control_block
+	{
+		using block_allocator = typename std::allocator_traits<Alloc>::template rebind_alloc<inplace_control_block>;
+		/// Of the unqualified type: std::allocator<const T> is ill-formed, payload of make_shared<const T> is not.
+		using payload_allocator = typename std::allocator_traits<Alloc>::template rebind_alloc<std::remove_cv_t<T>>;
+
+		explicit inplace_control_block(const Alloc& alloc)
+			: control_block(&storage_, &manage)
+			, alloc_(alloc)
+		{
+		}
+
+		[[nodiscard]] std::remove_cv_t<T>* payload() noexcept
+		{
+			return reinterpret_cast<std::remove_cv_t<T>*>(&storage_);
+		}
+
+		static void manage(control_block* control, const typename control_block::action what) noexcept
 		{
-			if (--control_->weak_usages_ == 0)
+			auto* self = static_cast<inplace_control_block*>(control);
+			if (what == control_block::action::destroy_payload)
 			{
-				delete control_;
+				payload_allocator alloc(self->alloc_);
+				std::allocator_traits<payload_allocator>::destroy(alloc, self->payload());
+			}
+			else
+			{
+				block_allocator alloc(self->alloc_);
+				std::allocator_traits<block_allocator>::destroy(alloc, self);
+				std::allocator_traits<block_allocator>::deallocate(alloc, self, 1);
 			}
 		}
-	}
 
-	explicit weak_ptr( const shared_ptr<T>& r ) noexcept
-		: control_(r.control_)
+		SMART_PTR_NO_UNIQUE_ADDRESS Alloc alloc_;
+		alignas(T) unsigned char storage_[sizeof(T)];
+	};
+
+	/// Array elements constructed right after the counters (make_shared<T[]>(n), make_shared<T[N]>()). One allocation.
+	/// Length is known at run time, so the block is allocated as units aligned for both the block and the elements.
+	struct inplace_array_block : control_block
 	{
-		if (control_)
+		static constexpr std::size_t alignment = std::max({alignof(control_block), alignof(std::size_t), alignof(element_type)});
+
+		struct alignas(alignment) unit
 		{
-			++control_->weak_usages_;
+			unsigned char bytes_[alignment];
+		};
+
+		std::size_t size_;
+
+		explicit inplace_array_block(const std::size_t size)
+			: control_block(nullptr, &manage)
+			, size_(size)
+		{
+			this->payload_ = elements();
 		}
-	}
 
-	// TODO: explicit did not compile
-	weak_ptr(const weak_ptr& r) noexcept
+		static constexpr std::size_t elements_offset() noexcept
+		{
+			return (sizeof(inplace_array_block) + alignof(element_type) - 1) / alignof(element_type) * alignof(element_type);
+		}
+
+		static std::size_t units(const std::size_t size)
+		{
+			if (size > (SIZE_MAX - elements_offset() - sizeof(unit)) / sizeof(element_type))
+			{
+				throw std::bad_array_new_length{};
+			}
+			return (elements_offset() + size * sizeof(element_type) + sizeof(unit) - 1) / sizeof(unit);
+		}
+
+		[[nodiscard]] element_type* elements() noexcept
+		{
+			return reinterpret_cast<element_type*>(reinterpret_cast<unsigned char*>(this) + elements_offset());
+		}
+
+		static void manage(control_block* control, const typename control_block::action what) noexcept
+		{
+			auto* self = static_cast<inplace_array_block*>(control);
+			if (what == control_block::action::destroy_payload)
+			{
+				// Reverse order of construction, as delete[] does.
+				for (std::size_t i = self->size_; i != 0; --i)
+				{
+					std::destroy_at(self->elements() + i - 1);
+				}
+			}
+			else
+			{
+				const std::size_t count = units(self->size_);
+				std::destroy_at(self);
+				std::allocator<unit>{}.deallocate(reinterpret_cast<unit*>(self), count);
+			}
+		}
+	};
+
+	/// Payload allocated by the caller, destroyed by Deleter. Control block allocated by Alloc (e.g. smart_ptr::pool_allocator).
+	/// Stateless deleter and allocator take no space. Dispatch is the manage_ pointer as for every block, no vtable.
+	template<typename Deleter, typename Alloc>
+	struct allocated_control_block : control_block
 	{
-		control_ = r.control_;
-		if (control_)
+		using block_allocator = typename std::allocator_traits<Alloc>::template rebind_alloc<allocated_control_block>;
+
+		allocated_control_block(element_type* payload, Deleter&& deleter, const Alloc& alloc)
+			: control_block(const_cast<std::remove_cv_t<element_type>*>(payload), &manage)
+			, deleter_(std::move(deleter))
+			, alloc_(alloc)
+		{
+		}
+
+		static void manage(control_block* control, const typename control_block::action what) noexcept
+		{
+			auto* self = static_cast<allocated_control_block*>(control);
+			if (what == control_block::action::destroy_payload)
+			{
+				self->deleter_(static_cast<element_type*>(self->payload_));
+			}
+			else
+			{
+				block_allocator alloc(self->alloc_);
+				std::allocator_traits<block_allocator>::destroy(alloc, self);
+				std::allocator_traits<block_allocator>::deallocate(alloc, self, 1);
+			}
+		}
+
+		SMART_PTR_NO_UNIQUE_ADDRESS Deleter deleter_;
+		SMART_PTR_NO_UNIQUE_ADDRESS Alloc alloc_;
+	};
+
+	/// Default deleter and allocator get the plain control block with manage_separate_.
+	template<typename Deleter, typename Alloc>
+	static control_block* new_separate_block_(element_type* ptr, Deleter&& deleter, const Alloc& alloc)
+	{
+		static_assert(!intrusive_, "ref_counted object is deleted by its own counters, no custom deleter or allocator");
+		if constexpr (std::is_same_v<Deleter, default_deleter_> && std::is_same_v<Alloc, default_allocator_>)
+		{
+			return new control_block(const_cast<std::remove_cv_t<element_type>*>(ptr), &manage_separate_);
+		}
+		else
 		{
-			++r.control_->weak_usages_;
+			using block = allocated_control_block<Deleter, Alloc>;
+			typename block::block_allocator block_alloc(alloc);
+			block* control = std::allocator_traits<typename block::block_allocator>::allocate(block_alloc, 1);
+			try
+			{
+				std::allocator_traits<typename block::block_allocator>::construct(block_alloc, control, ptr, std::move(deleter), alloc);
+			}
+			catch (...)
+			{
+				std::allocator_traits<typename block::block_allocator>::deallocate(block_alloc, control, 1);
+				throw;
+			}
+			return control;
 		}
 	}
 
-	weak_ptr& operator=(weak_ptr other) noexcept
+	control_block* control_{nullptr};
+	/// Pointer get() returns. Payload of control_, a subobject of it or a base class of it (aliasing, conversions, casts).
+	element_type* ptr_{nullptr};
+	/// Counter the reference of this instance is counted on. Empty for policies without tickets.
+	/// Default ticket is the one of the first reference, the one make_shared creates.
+	SMART_PTR_NO_UNIQUE_ADDRESS detail::ticket_t<Counting> ticket_{};
+
+	/// Takes over a control block with the strong count already counting this instance.
+	explicit shared_ptr(control_block* control) noexcept
+		: control_(control)
+		, ptr_(control ? static_cast<element_type*>(control->payload_) : nullptr)
 	{
-		std::swap(*this, other);
-		return *this;
 	}
 
-	weak_ptr& operator=(weak_ptr&& r) noexcept
+	/// Points to the payload of its control block. Holders which keep just the control block
+	/// (atomic_shared_ptr, hazard_shared_slot) can store only such a pointer.
+	[[nodiscard]] bool is_aliased_() const noexcept
 	{
-		std::swap(*this, r);
-		return *this;
+		return ptr_ != (control_ ? static_cast<element_type*>(control_->payload_) : nullptr);
 	}
 
-	[[nodiscard]] bool expired() const noexcept
+	/// Those holders rebuild get() from the payload, so an aliased or converted pointer to another address
+	/// (e.g. a second base class) would read the wrong object.
+	void require_not_aliased_() const noexcept
 	{
-		return (!control_) || (control_->usages_ == 0);
+		if (is_aliased_())
+		{
+			detail::fatal("smart_ptr: aliased or converted shared_ptr stored in a holder of the control block only\n");
+		}
 	}
 
-	shared_ptr<T> lock()noexcept
+	/// New owner of an object derived from enable_shared_from_this<U, Counting>: points its weak self-reference
+	/// to this control block, unless another shared_ptr already owns it. One weak increment, no allocation.
+	template<typename U>
+	void enable_shared_from_this_(const enable_shared_from_this<U, Counting>* base) noexcept
 	{
-		try
+		if (base && base->weak_this_.expired())
 		{
-			return expired() ? shared_ptr<T>{} : shared_ptr<T>{*this};
+			weak_ptr<U, Counting> self;
+			self.control_ = control_;
+			self.ptr_ = const_cast<U*>(static_cast<const U*>(ptr_));
+			control_->add_weak();
+			swap(base->weak_this_, self);
 		}
-		catch (const std::bad_weak_ptr&)
+	}
+
+	/// Other types and arrays.
+	void enable_shared_from_this_(...) noexcept
+	{
+	}
+
+	void finish_one_instance_()
+	{
+		if (control_ && detail::release_strong(control_, ticket_))
 		{
-			return shared_ptr<T>{};
+			detail::finish_strong(control_);
 		}
 	}
-};
 
-}
+	friend void swap(shared_ptr& lhs, shared_ptr& rhs) noexcept
+	{
+		std::swap(lhs.control_, rhs.control_);
+		std::swap(lhs.ptr_, rhs.ptr_);
+		std::swap(lhs.ticket_, rhs.ticket_);
+	}
+
+public:
+	constexpr shared_ptr() noexcept = default;
+
+	constexpr explicit shared_ptr(std::nullptr_t) noexcept{}
+
+	/// Array types (T[], T[N]) take a pointer to the first element and free it by delete[].
+	explicit shared_ptr(element_type* ptr)
+		requires (!intrusive_)
+		: shared_ptr(ptr, default_deleter_{})
+	{
+	}
+
+	/// Object of a derived type is deleted as Y, as by std::shared_ptr: destructor of T need not be virtual.
+	template<typename Y>
+		requires (!intrusive_ && !std::is_array_v<T> && !std::is_same_v<std::remove_cv_t<Y>, std::remove_cv_t<T>> && std::is_convertible_v<Y*, T*>)
+	explicit shared_ptr(Y* ptr)
+		: shared_ptr(ptr, deleter_for_(ptr))
+	{
+	}
+
+	/// Object with its own counters (ref_counted): no allocation. ptr may also be this of an object owned already.
+	explicit shared_ptr(element_type* ptr) noexcept
+		requires intrusive_
+		: ptr_(ptr)
+	{
+		if (ptr_)
+		{
+			control_ = static_cast<detail::ref_counted_base_t<T, Counting>*>(const_cast<std::remove_cv_t<T>*>(ptr_))->own_(ptr_, ticket_);
+			enable_shared_from_this_(ptr_);
+		}
+	}
+
+	/// Object of a derived type with its own counters: they destroy and free it as Y, not as T. Destructor of T
+	/// need not be virtual and the counters need not be at the start of Y.
+	template<typename Y>
+		requires (intrusive_ && !std::is_same_v<std::remove_cv_t<Y>, std::remove_cv_t<T>> && std::is_convertible_v<Y*, T*>)
+	explicit shared_ptr(Y* ptr) noexcept
+		: ptr_(ptr)
+	{
+		if (ptr_)
+		{
+			control_ = static_cast<detail::ref_counted_base_t<T, Counting>*>(const_cast<std::remove_cv_t<Y>*>(ptr))->own_(ptr, ticket_);
+			enable_shared_from_this_(ptr_);
+		}
+	}
+
+	/// deleter(ptr) destroys the object. Stored in the control block.
+	template<typename Deleter>
+		requires std::is_invocable_v<Deleter&, element_type*>
+	shared_ptr(element_type* ptr, Deleter deleter)
+		: shared_ptr(ptr, std::move(deleter), default_allocator_{})
+	{
+	}
+
+	/// Allocator is used for the control block only. When it throws, deleter destroys the object.
+	template<typename Deleter, typename Alloc>
+		requires std::is_invocable_v<Deleter&, element_type*>
+	shared_ptr(element_type* ptr, Deleter deleter, const Alloc& alloc)
+	try
+		: control_(ptr ? new_separate_block_(ptr, std::move(deleter), alloc) : nullptr)
+		, ptr_(ptr)
+	{
+		if constexpr (!std::is_array_v<T>)
+		{
+			enable_shared_from_this_(ptr_);
+		}
+	}
+	catch(...)
+	{
+		deleter(ptr);
+		throw;
+	}
+
+	template<typename Deleter>
+		requires (!std::is_reference_v<Deleter>)
+	explicit shared_ptr(std::unique_ptr<T, Deleter>&& ptr)
+		: control_(ptr ? new_separate_block_(ptr.get(), std::move(ptr.get_deleter()), default_allocator_{}) : nullptr)
+		, ptr_(ptr.release())
+	{
+		if constexpr (!std::is_array_v<T>)
+		{
+			enable_shared_from_this_(ptr_);
+		}
+	}
+
+	explicit shared_ptr(std::unique_ptr<T>&& ptr) noexcept
+		requires intrusive_
+		: shared_ptr(ptr.release())
+	{
+	}
+
+	~shared_ptr() noexcept
+	{
+		finish_one_instance_();
+	}
+
+	shared_ptr(const shared_ptr& other) noexcept
+		: shared_ptr(other, other.ptr_)
+	{
+	}
+
+	shared_ptr(shared_ptr&& other) noexcept
+	{
+		std::swap(control_, other.control_);
+		std::swap(ptr_, other.ptr_);
+		std::swap(ticket_, other.ticket_);
+	}
+
+	/// Shares the control block of a shared_ptr to a derived class. One increment, no allocation.
+	template<typename Y>
+		requires std::is_convertible_v<Y*, T*>
+	shared_ptr(const shared_ptr<Y, Counting>& other) noexcept
+		: shared_ptr(other, other.ptr_)
+	{
+	}
+
+	/// Takes over the reference of other. No count changes.
+	template<typename Y>
+		requires std::is_convertible_v<Y*, T*>
+	shared_ptr(shared_ptr<Y, Counting>&& other) noexcept
+		: shared_ptr(std::move(other), other.ptr_)
+	{
+	}
+
+	/// Aliasing: shares ownership with owner, get() returns ptr (usually a member of the owned object).
+	template<typename Y>
+	shared_ptr(const shared_ptr<Y, Counting>& owner, element_type* ptr) noexcept
+		: control_(owner.control_)
+		, ptr_(ptr)
+	{
+		if (control_)
+		{
+			// here at least one valid shared ptr exists. No need to check usages_ for zero.
+			ticket_ = detail::add_strong(control_);
+		}
+	}
+
+	/// Aliasing, takes over the reference of owner. No count changes.
+	template<typename Y>
+	shared_ptr(shared_ptr<Y, Counting>&& owner, element_type* ptr) noexcept
+		: control_(std::exchange(owner.control_, nullptr))
+		, ptr_(ptr)
+		, ticket_(std::exchange(owner.ticket_, {}))
+	{
+		owner.ptr_ = nullptr;
+	}
+
+	template< class Y >
+		requires std::is_convertible_v<Y*, T*>
+	explicit shared_ptr( const weak_ptr<Y, Counting>& r )
+		: control_(r.control_)
+		, ptr_(r.ptr_)
+	{
+		if (!control_ || !detail::try_add_strong(control_, ticket_))
+		{
+			throw std::bad_weak_ptr{};
+		}
+	}
+
+	// This = operator works for both l-value and r-value.
+	shared_ptr& operator=(shared_ptr other) noexcept
+	{
+		using std::swap;
+		swap(*this, other); 
+		return *this;
+	}
+
+	friend bool operator==(const shared_ptr& lhs, const shared_ptr& rhs)
+	{
+		return lhs.get() == rhs.get();
+	}
+
+	friend bool operator!=(const shared_ptr& lhs, const shared_ptr& rhs)
+	{
+		return !(lhs == rhs);
+	}
+
+	[[nodiscard]] explicit operator bool() const noexcept
+	{
+		return ptr_ != nullptr;
+	}
+	
+	void reset() noexcept 
+	{
+		finish_one_instance_();
+		control_ = nullptr;
+		ptr_ = nullptr;
+		ticket_ = {};
+	}
+
+	[[nodiscard]] element_type* get() const noexcept
+	{
+		return ptr_;
+	}
+
+	[[nodiscard]] element_type& operator*() const noexcept
+		requires (!std::is_array_v<T>)
+	{
+		return *get();
+	}
+
+	[[nodiscard]] element_type* operator->() const noexcept
+		requires (!std::is_array_v<T>)
+	{
+		return get();
+	}
+
+	[[nodiscard]] element_type& operator[](const std::ptrdiff_t index) const noexcept
+		requires std::is_array_v<T>
+	{
+		return get()[index];
+	}
+
+	[[nodiscard]] long use_count() const noexcept
+	{
+		return control_ ? control_->use_count() : 0;
+	}
+
+	/// Ownership order and equality compare control blocks: aliases of one object are equivalent,
+	/// a weak_ptr keeps its key after expiry. Nothing is loaded from the block.
+	template<typename U>
+	[[nodiscard]] bool owner_before(const shared_ptr<U, Counting>& other) const noexcept
+	{
+		return std::less<const void*>{}(control_, other.control_);
+	}
+
+	template<typename U>
+	[[nodiscard]] bool owner_before(const weak_ptr<U, Counting>& other) const noexcept
+	{
+		return std::less<const void*>{}(control_, other.control_);
+	}
+
+	template<typename U>
+	[[nodiscard]] bool owner_equal(const shared_ptr<U, Counting>& other) const noexcept
+	{
+		return control_ == other.control_;
+	}
+
+	template<typename U>
+	[[nodiscard]] bool owner_equal(const weak_ptr<U, Counting>& other) const noexcept
+	{
+		return control_ == other.control_;
+	}
+
+	[[nodiscard]] std::size_t owner_hash() const noexcept
+	{
+		return std::hash<const void*>{}(control_);
+	}
+};
+
+template< class T, class U, class Counting >
+std::strong_ordering operator<=>( const shared_ptr<T, Counting>& lhs, const shared_ptr<U, Counting>& rhs ) noexcept
+{
+	return std::compare_three_way{}(lhs.get(), rhs.get());
+};
+
+/// Casts share the control block of r. Copy: one increment. Move: no count change. None allocates.
+template<typename T, typename U, typename Counting>
+shared_ptr<T, Counting> static_pointer_cast(const shared_ptr<U, Counting>& r) noexcept
+{
+	return shared_ptr<T, Counting>(r, static_cast<typename shared_ptr<T, Counting>::element_type*>(r.get()));
+}
+
+template<typename T, typename U, typename Counting>
+shared_ptr<T, Counting> static_pointer_cast(shared_ptr<U, Counting>&& r) noexcept
+{
+	auto* ptr = static_cast<typename shared_ptr<T, Counting>::element_type*>(r.get());
+	return shared_ptr<T, Counting>(std::move(r), ptr);
+}
+
+/// Empty when the cast fails. Then r is not moved from.
+template<typename T, typename U, typename Counting>
+shared_ptr<T, Counting> dynamic_pointer_cast(const shared_ptr<U, Counting>& r) noexcept
+{
+	if (auto* ptr = dynamic_cast<typename shared_ptr<T, Counting>::element_type*>(r.get()))
+	{
+		return shared_ptr<T, Counting>(r, ptr);
+	}
+	return shared_ptr<T, Counting>{};
+}
+
+template<typename T, typename U, typename Counting>
+shared_ptr<T, Counting> dynamic_pointer_cast(shared_ptr<U, Counting>&& r) noexcept
+{
+	if (auto* ptr = dynamic_cast<typename shared_ptr<T, Counting>::element_type*>(r.get()))
+	{
+		return shared_ptr<T, Counting>(std::move(r), ptr);
+	}
+	return shared_ptr<T, Counting>{};
+}
+
+template<typename T, typename U, typename Counting>
+shared_ptr<T, Counting> const_pointer_cast(const shared_ptr<U, Counting>& r) noexcept
+{
+	return shared_ptr<T, Counting>(r, const_cast<typename shared_ptr<T, Counting>::element_type*>(r.get()));
+}
+
+template<typename T, typename U, typename Counting>
+shared_ptr<T, Counting> const_pointer_cast(shared_ptr<U, Counting>&& r) noexcept
+{
+	auto* ptr = const_cast<typename shared_ptr<T, Counting>::element_type*>(r.get());
+	return shared_ptr<T, Counting>(std::move(r), ptr);
+}
+
+template<typename T, typename U, typename Counting>
+shared_ptr<T, Counting> reinterpret_pointer_cast(const shared_ptr<U, Counting>& r) noexcept
+{
+	return shared_ptr<T, Counting>(r, reinterpret_cast<typename shared_ptr<T, Counting>::element_type*>(r.get()));
+}
+
+template<typename T, typename U, typename Counting>
+shared_ptr<T, Counting> reinterpret_pointer_cast(shared_ptr<U, Counting>&& r) noexcept
+{
+	auto* ptr = reinterpret_cast<typename shared_ptr<T, Counting>::element_type*>(r.get());
+	return shared_ptr<T, Counting>(std::move(r), ptr);
+}
+
+template<typename T, typename Counting>
+class weak_ptr
+{
+	template<typename U, typename C>
+	friend class shared_ptr;
+	template<typename U, typename C>
+	friend class weak_ptr;
+	template<typename U, typename C>
+	friend class enable_shared_from_this;
+
+	typename shared_ptr<T, Counting>::control_block* control_{nullptr};
+	/// What lock() returns a shared_ptr to (aliased or converted pointer of the shared_ptr this was made from).
+	typename shared_ptr<T, Counting>::element_type* ptr_{nullptr};
+
+public:
+	friend void swap(weak_ptr& lhs, weak_ptr& rhs) noexcept
+	{
+		std::swap(lhs.control_, rhs.control_);
+		std::swap(lhs.ptr_, rhs.ptr_);
+	}
+
+	constexpr weak_ptr() noexcept = default;
+
+	~weak_ptr()
+	{
+		if (control_ && control_->release_weak())
+		{
+			detail::finish_weak(control_);
+		}
+	}
+
+	/// Not for objects of ref_counted<Counting, false>, their memory is freed with the last shared_ptr.
+	explicit weak_ptr( const shared_ptr<T, Counting>& r ) noexcept
+		requires (!std::is_same_v<detail::ref_counted_base_t<T, Counting>, ref_counted<Counting, false>>)
+		: control_(r.control_)
+		, ptr_(r.ptr_)
+	{
+		if (control_)
+		{
+			control_->add_weak();
+		}
+	}
+
+	// TODO: explicit did not compile
+	weak_ptr(const weak_ptr& r) noexcept
+	{
+		control_ = r.control_;
+		ptr_ = r.ptr_;
+		if (control_)
+		{
+			control_->add_weak();
+		}
+	}
+
+	weak_ptr& operator=(weak_ptr other) noexcept
+	{
+		std::swap(*this, other);
+		return *this;
+	}
+
+	weak_ptr& operator=(weak_ptr&& r) noexcept
+	{
+		std::swap(*this, r);
+		return *this;
+	}
+
+	[[nodiscard]] bool expired() const noexcept
+	{
+		return (!control_) || (control_->use_count() == 0);
+	}
+
+	/// No exception and, with atomic_counting, no loop: one increment-if-not-zero of the strong count.
+	[[nodiscard]] shared_ptr<T, Counting> lock() const noexcept
+	{
+		shared_ptr<T, Counting> result;
+		if (control_ && detail::try_add_strong(control_, result.ticket_))
+		{
+			result.control_ = control_;
+			result.ptr_ = ptr_;
+		}
+		return result;
+	}
+
+	/// Same keys as shared_ptr::owner_before, owner_equal and owner_hash.
+	template<typename U>
+	[[nodiscard]] bool owner_before(const shared_ptr<U, Counting>& other) const noexcept
+	{
+		return std::less<const void*>{}(control_, other.control_);
+	}
+
+	template<typename U>
+	[[nodiscard]] bool owner_before(const weak_ptr<U, Counting>& other) const noexcept
+	{
+		return std::less<const void*>{}(control_, other.control_);
+	}
+
+	template<typename U>
+	[[nodiscard]] bool owner_equal(const shared_ptr<U, Counting>& other) const noexcept
+	{
+		return control_ == other.control_;
+	}
+
+	template<typename U>
+	[[nodiscard]] bool owner_equal(const weak_ptr<U, Counting>& other) const noexcept
+	{
+		return control_ == other.control_;
+	}
+
+	[[nodiscard]] std::size_t owner_hash() const noexcept
+	{
+		return std::hash<const void*>{}(control_);
+	}
+};
+
+/// Base for objects which hand out shared_ptrs to themselves (e.g. captured by async callbacks).
+/// Holds a weak_ptr set by the first shared_ptr(T*), shared_ptr(unique_ptr) or make_shared owning the object.
+/// With make_shared it points to the block the object lives in. Counting must be the one of the owning shared_ptr.
+template<typename T, typename Counting>
+class enable_shared_from_this
+{
+	template<typename U, typename C>
+	friend class shared_ptr;
+
+	mutable weak_ptr<T, Counting> weak_this_;
+
+	/// Caller is inside the object, so a shared_ptr owns it: one increment without checking for zero.
+	template<typename U>
+	shared_ptr<U, Counting> share_() const
+	{
+		if (!weak_this_.control_)
+		{
+			throw std::bad_weak_ptr{};
+		}
+		assert(!weak_this_.expired() && "shared_from_this() of an object being destroyed");
+		shared_ptr<U, Counting> result;
+		result.control_ = weak_this_.control_;
+		result.ptr_ = weak_this_.ptr_;
+		result.ticket_ = detail::add_strong(result.control_);
+		return result;
+	}
+
+	template<typename U>
+	weak_ptr<U, Counting> observe_() const noexcept
+	{
+		weak_ptr<U, Counting> result;
+		result.control_ = weak_this_.control_;
+		result.ptr_ = weak_this_.ptr_;
+		if (result.control_)
+		{
+			result.control_->add_weak();
+		}
+		return result;
+	}
+
+protected:
+	constexpr enable_shared_from_this() noexcept = default;
+
+	/// Copy of an object is not owned by the owners of the original.
+	enable_shared_from_this(const enable_shared_from_this&) noexcept
+	{
+	}
+
+	enable_shared_from_this& operator=(const enable_shared_from_this&) noexcept
+	{
+		return *this;
+	}
+
+	~enable_shared_from_this() = default;
+
+public:
+	/// Throws std::bad_weak_ptr when no shared_ptr owns the object.
+	[[nodiscard]] shared_ptr<T, Counting> shared_from_this()
+	{
+		return share_<T>();
+	}
+
+	[[nodiscard]] shared_ptr<const T, Counting> shared_from_this() const
+	{
+		return share_<const T>();
+	}
+
+	/// Empty when no shared_ptr owns the object.
+	[[nodiscard]] weak_ptr<T, Counting> weak_from_this() noexcept
+	{
+		return observe_<T>();
+	}
+
+	[[nodiscard]] weak_ptr<const T, Counting> weak_from_this() const noexcept
+	{
+		return observe_<const T>();
+	}
+};
+
+/// Base for objects which carry their own counters (intrusive counting). shared_ptr<T, Counting> of a type derived
+/// from ref_counted<Counting> uses them as its control block: shared_ptr(new T) and make_shared allocate only the object,
+/// and this of an owned object can be shared again by shared_ptr<T>(this).
+///	- Weak = true: weak_ptr works. The last shared_ptr destroys the object, the last weak_ptr frees its memory.
+///	  Object must be allocated by ::new (global operator new, a class operator new is not paired), or by make_shared.
+///	- Weak = false: no weak_ptr. The last shared_ptr deletes the object, so a class operator delete and a virtual
+///	  destructor of a base are used as by delete.
+/// First owner records the type it was given: shared_ptr<Base>(new Derived) destroys and frees a Derived.
+/// Copy of an object gets counters of its own. Counting must be the one of the owning shared_ptr, derive publicly.
+template<typename Counting, bool Weak>
+class ref_counted
+{
+	template<typename U, typename C>
+	friend class shared_ptr;
+
+	using control_block = detail::control_block<Counting>;
+
+	/// Control block is a separate object in the storage of this one, so it outlives the destructor of the object
+	/// while weak_ptrs point to it. No payload and no manager until the first shared_ptr owns the object.
+	alignas(control_block) unsigned char block_storage_[sizeof(control_block)];
+
+	[[nodiscard]] control_block* block_() noexcept
+	{
+		return std::launder(reinterpret_cast<control_block*>(&block_storage_));
+	}
+
+	/// First owner sets the block up for T with its reference already counted. Later owners (shared_ptr(this))
+	/// are made from inside an owned object: one increment without checking for zero.
+	template<typename T>
+	control_block* own_(T* object, detail::ticket_t<Counting>& ticket) noexcept
+	{
+		control_block* control = block_();
+		if (control->manage_)
+		{
+			ticket = detail::add_strong(control);
+		}
+		else
+		{
+			control->payload_ = const_cast<std::remove_cv_t<T>*>(object);
+			control->manage_ = &manage_<std::remove_cv_t<T>>;
+		}
+		return control;
+	}
+
+	template<typename T>
+	static void manage_(control_block* control, const typename control_block::action what) noexcept
+	{
+		auto* object = static_cast<T*>(control->payload_);
+		if constexpr (Weak)
+		{
+			if (what == control_block::action::destroy_payload)
+			{
+				// Memory of the most derived object is what new returned. Kept for the last weak_ptr.
+				void* memory = object;
+				if constexpr (std::is_polymorphic_v<T>)
+				{
+					memory = dynamic_cast<void*>(object);
+				}
+				std::destroy_at(object);
+				control->payload_ = memory;
+			}
+			else
+			{
+				void* memory = control->payload_;
+				std::destroy_at(control);
+				if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+				{
+					::operator delete(memory, std::align_val_t{alignof(T)});
+				}
+				else
+				{
+					::operator delete(memory);
+				}
+			}
+		}
+		else if (what == control_block::action::free_block)
+		{
+			// No weak_ptr, so the block is freed right after the object is released. ~ref_counted destroys the block.
+			delete object;
+		}
+	}
+
+protected:
+	ref_counted() noexcept(std::is_nothrow_constructible_v<control_block, void*, typename control_block::manager>)
+	{
+		::new (static_cast<void*>(&block_storage_)) control_block(nullptr, nullptr);
+	}
+
+	/// Copy of an object is not owned by the owners of the original.
+	ref_counted(const ref_counted&) noexcept(std::is_nothrow_constructible_v<control_block, void*, typename control_block::manager>)
+		: ref_counted()
+	{
+	}
+
+	ref_counted& operator=(const ref_counted&) noexcept
+	{
+		return *this;
+	}
+
+	/// Owned object with weak support: the last weak_ptr destroys the block after this.
+	~ref_counted()
+	{
+		if (!Weak || !block_()->manage_)
+		{
+			std::destroy_at(block_());
+		}
+	}
+};
+
+namespace detail
+{
+
+#if defined(SMART_PTR_CHECKED_VIEWS)
+inline constexpr bool checked_views = true;
+#else
+inline constexpr bool checked_views = false;
+#endif
+
+/// Control block of a shared_view. Unchecked: just the pointer, copied and destroyed trivially.
+template<typename Counting, bool Checked>
+struct view_base
+{
+	control_block<Counting>* control_{nullptr};
+
+	constexpr view_base() noexcept = default;
+
+	explicit view_base(control_block<Counting>* control) noexcept
+		: control_(control)
+	{
+	}
+
+	void check_() const noexcept
+	{
+	}
+};
+
+/// Checked: holds a weak reference, so the block can be asked whether the object is still alive.
+template<typename Counting>
+struct view_base<Counting, true>
+{
+	control_block<Counting>* control_{nullptr};
+
+	constexpr view_base() noexcept = default;
+
+	explicit view_base(control_block<Counting>* control) noexcept
+		: control_(control)
+	{
+		if (control_)
+		{
+			control_->add_weak();
+		}
+	}
+
+	view_base(const view_base& other) noexcept
+		: view_base(other.control_)
+	{
+	}
+
+	view_base& operator=(const view_base& other) noexcept
+	{
+		view_base copy(other);
+		std::swap(control_, copy.control_);
+		return *this;
+	}
+
+	~view_base()
+	{
+		if (control_ && control_->release_weak())
+		{
+			finish_weak(control_);
+		}
+	}
+
+	void check_() const noexcept
+	{
+		if (control_ && control_->use_count() == 0)
+		{
+			fatal("smart_ptr::shared_view used after the last shared_ptr owning its object was destroyed\n");
+		}
+	}
+};
+
+}
+
+/// Borrowed, non-owning pointer to an object owned by a shared_ptr. Pass it by value instead of const shared_ptr&.
+///	- Construction and copies do not touch the counts. Some shared_ptr must keep the object alive while the view is used.
+///	- share() makes an owning shared_ptr with one increment, for a callee which keeps the object.
+///	- Unchecked (default): payload and control block pointer as in shared_ptr, trivially copyable. Checked (SMART_PTR_CHECKED_VIEWS): holds a weak reference
+///	  and aborts when used after the object is destroyed.
+template<typename T, typename Counting = atomic_counting, bool Checked = detail::checked_views>
+class basic_shared_view : detail::view_base<Counting, Checked>
+{
+	using base = detail::view_base<Counting, Checked>;
+	using element_type = typename shared_ptr<T, Counting>::element_type;
+
+	element_type* ptr_{nullptr};
+
+public:
+	constexpr basic_shared_view() noexcept = default;
+
+	constexpr basic_shared_view(std::nullptr_t) noexcept
+	{
+	}
+
+	basic_shared_view(const shared_ptr<T, Counting>& owner) noexcept
+		: base(owner.control_)
+		, ptr_(owner.ptr_)
+	{
+	}
+
+	[[nodiscard]] explicit operator bool() const noexcept
+	{
+		return ptr_ != nullptr;
+	}
+
+	[[nodiscard]] element_type* get() const noexcept
+	{
+		this->check_();
+		return ptr_;
+	}
+
+	[[nodiscard]] element_type& operator*() const noexcept
+		requires (!std::is_array_v<T>)
+	{
+		return *get();
+	}
+
+	[[nodiscard]] element_type* operator->() const noexcept
+		requires (!std::is_array_v<T>)
+	{
+		return get();
+	}
+
+	[[nodiscard]] element_type& operator[](const std::ptrdiff_t index) const noexcept
+		requires std::is_array_v<T>
+	{
+		return get()[index];
+	}
+
+	[[nodiscard]] long use_count() const noexcept
+	{
+		return this->control_ ? this->control_->use_count() : 0;
+	}
+
+	/// Owning pointer to the same object. Object is alive (borrowed), so no check for zero is needed.
+	[[nodiscard]] shared_ptr<T, Counting> share() const noexcept
+	{
+		this->check_();
+		shared_ptr<T, Counting> result;
+		result.control_ = this->control_;
+		result.ptr_ = ptr_;
+		if (this->control_)
+		{
+			result.ticket_ = detail::add_strong(this->control_);
+		}
+		return result;
+	}
+
+	friend bool operator==(const basic_shared_view& lhs, const basic_shared_view& rhs) noexcept
+	{
+		return lhs.ptr_ == rhs.ptr_;
+	}
+};
+
+template<typename T, typename Counting = atomic_counting>
+using shared_view = basic_shared_view<T, Counting, detail::checked_views>;
+
+namespace detail
+{
+
+/// Control blocks with the payload inside, shared by make_shared, make_shared_for_overwrite and allocate_shared.
+template<typename T, typename Counting>
+struct shared_ptr_factory
+{
+	using pointer = shared_ptr<T, Counting>;
+	using control_block = typename pointer::control_block;
+
+	/// One T inside the block. construct(remove_cv_t<T>*) constructs it, the block is freed when it throws.
+	template<typename Alloc, typename Construct>
+	static pointer inplace(const Alloc& alloc, Construct&& construct)
+	{
+		using block = typename pointer::template inplace_control_block<Alloc>;
+		typename block::block_allocator block_alloc(alloc);
+		block* control = std::allocator_traits<typename block::block_allocator>::allocate(block_alloc, 1);
+		try
+		{
+			std::allocator_traits<typename block::block_allocator>::construct(block_alloc, control, alloc);
+		}
+		catch (...)
+		{
+			std::allocator_traits<typename block::block_allocator>::deallocate(block_alloc, control, 1);
+			throw;
+		}
+		try
+		{
+			construct(control->payload());
+		}
+		catch (...)
+		{
+			std::allocator_traits<typename block::block_allocator>::destroy(block_alloc, control);
+			std::allocator_traits<typename block::block_allocator>::deallocate(block_alloc, control, 1);
+			throw;
+		}
+		pointer result{static_cast<control_block*>(control)};
+		result.enable_shared_from_this_(result.ptr_);
+		return result;
+	}
+
+	/// Block made elsewhere (object_pool), its strong count already counting the new pointer.
+	static pointer adopt(control_block* control) noexcept
+	{
+		return pointer{control};
+	}
+
+	/// size elements after the block. Value-initialized, or default-initialized (left as is for trivial types) for overwrite.
+	static pointer array(const std::size_t size, const bool value_initialize)
+	{
+		using block = typename pointer::inplace_array_block;
+		std::allocator<typename block::unit> alloc;
+		const std::size_t units = block::units(size);
+		typename block::unit* storage = alloc.allocate(units);
+		block* control = nullptr;
+		try
+		{
+			control = ::new (static_cast<void*>(storage)) block(size);
+			if (value_initialize)
+			{
+				std::uninitialized_value_construct_n(control->elements(), size);
+			}
+			else
+			{
+				std::uninitialized_default_construct_n(control->elements(), size);
+			}
+		}
+		catch (...)
+		{
+			if (control)
+			{
+				std::destroy_at(control);
+			}
+			alloc.deallocate(storage, units);
+			throw;
+		}
+		return pointer{static_cast<control_block*>(control)};
+	}
+};
+
+}
+
+/// Single allocation for control block and T. Allocator is used for both (rebound) and to construct T.
+template<typename T, typename Counting, typename Alloc, typename... Args>
+shared_ptr<T, Counting> allocate_shared(const Alloc& alloc, Args&&... args)
+{
+	static_assert(!std::is_array_v<T>, "Arrays are supported by make_shared and make_shared_for_overwrite only");
+	static_assert(!detail::is_ref_counted<T, Counting>, "ref_counted object is allocated by new, use make_shared");
+	return detail::shared_ptr_factory<T, Counting>::inplace(alloc, [&alloc, &args...](std::remove_cv_t<T>* payload)
+	{
+		using payload_allocator = typename std::allocator_traits<Alloc>::template rebind_alloc<std::remove_cv_t<T>>;
+		payload_allocator payload_alloc(alloc);
+		std::allocator_traits<payload_allocator>::construct(payload_alloc, payload, std::forward<Args>(args)...);
+	});
+}
+
+template<typename T, typename Counting = atomic_counting, typename... Args>
+	requires (!std::is_array_v<T>)
+shared_ptr<T, Counting> make_shared(Args&&... args)
+{
+	// Counters are inside the object, there is no block to construct it in.
+	if constexpr (detail::is_ref_counted<T, Counting>)
+	{
+		// Global new: Weak = true frees the memory with the global operator delete.
+		return shared_ptr<T, Counting>(::new T(std::forward<Args>(args)...));
+	}
+	else
+	{
+		return smart_ptr::allocate_shared<T, Counting>(std::allocator<std::remove_cv_t<T>>{}, std::forward<Args>(args)...);
+	}
+}
+
+/// size value-initialized elements right after the control block. One allocation.
+template<typename T, typename Counting = atomic_counting>
+	requires std::is_unbounded_array_v<T>
+shared_ptr<T, Counting> make_shared(const std::size_t size)
+{
+	return detail::shared_ptr_factory<T, Counting>::array(size, true);
+}
+
+template<typename T, typename Counting = atomic_counting>
+	requires std::is_bounded_array_v<T>
+shared_ptr<T, Counting> make_shared()
+{
+	return detail::shared_ptr_factory<T, Counting>::array(std::extent_v<T>, true);
+}
+
+/// Default-initialized: no zeroing of trivial types, for buffers which are written before they are read.
+template<typename T, typename Counting = atomic_counting>
+	requires (!std::is_array_v<T>)
+shared_ptr<T, Counting> make_shared_for_overwrite()
+{
+	if constexpr (detail::is_ref_counted<T, Counting>)
+	{
+		return shared_ptr<T, Counting>(::new T);
+	}
+	else
+	{
+		return detail::shared_ptr_factory<T, Counting>::inplace(std::allocator<std::remove_cv_t<T>>{}, [](std::remove_cv_t<T>* payload)
+		{
+			::new (static_cast<void*>(payload)) T;
+		});
+	}
+}
+
+template<typename T, typename Counting = atomic_counting>
+	requires std::is_unbounded_array_v<T>
+shared_ptr<T, Counting> make_shared_for_overwrite(const std::size_t size)
+{
+	return detail::shared_ptr_factory<T, Counting>::array(size, false);
+}
+
+template<typename T, typename Counting = atomic_counting>
+	requires std::is_bounded_array_v<T>
+shared_ptr<T, Counting> make_shared_for_overwrite()
+{
+	return detail::shared_ptr_factory<T, Counting>::array(std::extent_v<T>, false);
+}
+
+/// Transparent functors keying ordered and hashed containers by ownership (control block address), for shared_ptr and
+/// weak_ptr alike. owner_less matches std::owner_less<void>, owner_hash and owner_equal the C++26 std ones.
+struct owner_less
+{
+	using is_transparent = void;
+
+	template<typename L, typename R>
+	bool operator()(const L& lhs, const R& rhs) const noexcept
+	{
+		return lhs.owner_before(rhs);
+	}
+};
+
+struct owner_hash
+{
+	using is_transparent = void;
+
+	template<typename P>
+	std::size_t operator()(const P& ptr) const noexcept
+	{
+		return ptr.owner_hash();
+	}
+};
+
+struct owner_equal
+{
+	using is_transparent = void;
+
+	template<typename L, typename R>
+	bool operator()(const L& lhs, const R& rhs) const noexcept
+	{
+		return lhs.owner_equal(rhs);
+	}
+};
+
+/// Pointers to an object which never leaves one thread. No atomic instruction on copy or destruction.
+template<typename T>
+using local_shared_ptr = shared_ptr<T, local_counting>;
+
+template<typename T>
+using local_weak_ptr = weak_ptr<T, local_counting>;
+
+template<typename T, typename... Args>
+local_shared_ptr<T> make_local_shared(Args&&... args)
+{
+	return make_shared<T, local_counting>(std::forward<Args>(args)...);
+}
+
+}
+
+/// Hash of get(), consistent with operator==. The pointer is a member of shared_ptr, so hashing loads nothing else.
+template<typename T, typename Counting>
+struct std::hash<smart_ptr::shared_ptr<T, Counting>>
+{
+	std::size_t operator()(const smart_ptr::shared_ptr<T, Counting>& ptr) const noexcept
+	{
+		return std::hash<typename smart_ptr::shared_ptr<T, Counting>::element_type*>{}(ptr.get());
+	}
+};
@@ -1,7 +1,13 @@
 #define CATCH_CONFIG_RUNNER
 #include "catch.hpp"
+#include "alive_counter.h"
 #include "shared_ptr.h"
 
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
 unsigned int Factorial( unsigned int number ) {
 	return number <= 1 ? number : Factorial(number-1)*number;
 }
@@ -273,6 +279,56 @@ TEST_CASE("Weak ptr keeps control block.")
 		REQUIRE(locked.get() == payload);
 		REQUIRE(my_ptr.get() == payload);
 	}
+
+	SECTION("Failed locks do not revive an expired object")
+	{
+		const auto exp_weak {createExpiredWeakPtr()};
+		STATIC_REQUIRE(noexcept(exp_weak.lock()));
+		for (int i = 0; i < 100; ++i)
+		{
+			REQUIRE(!exp_weak.lock());
+		}
+		REQUIRE(exp_weak.expired());
+	}
+}
+
+TEST_CASE("weak_ptr::lock racing the last release")
+{
+	constexpr int rounds = 2'000;
+	int locked_after_expiry = 0;
+	int destroyed_twice = 0;
+	for (int round = 0; round < rounds; ++round)
+	{
+		std::atomic<int> destroyed{0};
+		auto owner = smart_ptr::shared_ptr<int>(new int(round), [&destroyed](const int* p)
+		{
+			++destroyed;
+			delete p;
+		});
+		const smart_ptr::weak_ptr<int> observer(owner);
+		std::thread locker([&observer, &locked_after_expiry, round]
+		{
+			// Once a lock fails, the object stays expired.
+			bool failed = false;
+			for (int i = 0; i < 16; ++i)
+			{
+				const auto locked = observer.lock();
+				if (!locked)
+				{
+					failed = true;
+				}
+				else if (failed || *locked != round)
+				{
+					++locked_after_expiry;
+				}
+			}
+		});
+		owner.reset();
+		locker.join();
+		destroyed_twice += destroyed != 1;
+	}
+	REQUIRE(locked_after_expiry == 0);
+	REQUIRE(destroyed_twice == 0);
 }
 
 struct MyObjectDeleterFunctor {  
@@ -301,8 +357,17 @@ TEST_CASE("Converting unique pointer to shared_ptr")
 }
 
 std::atomic_int break_new{0};
+std::atomic_int new_calls{0};
+
+// GCC must see calls of operator new and operator delete. Inlined into malloc on one side and not into free on the
+// other (or the other way round), -Wmismatched-new-delete reports a mismatch which is not there.
+#if defined(__GNUC__)
+#define TEST_ALLOCATION_FUNCTION [[gnu::noinline]]
+#else
+#define TEST_ALLOCATION_FUNCTION
+#endif
 
-void* operator new( std::size_t size, const std::nothrow_t& tag ) noexcept
+TEST_ALLOCATION_FUNCTION void* operator new( std::size_t size, const std::nothrow_t& tag ) noexcept
 {
 	//std::printf("1) new(size_t, nothrow), size = %zu\n", size);
 	if (int expected = 1; break_new.compare_exchange_strong(expected, 0))
@@ -316,9 +381,10 @@ void* operator new( std::size_t size, const std::nothrow_t& tag ) noexcept
 	return std::malloc(size);
 }
 
-void* operator new(std::size_t size)
+TEST_ALLOCATION_FUNCTION void* operator new(std::size_t size)
 {
 	//std::printf("1) new(size_t), size = %zu\n", size);
+	++new_calls;
 	if (int expected = 1; break_new.compare_exchange_strong(expected, 0))
 	{
 		throw std::bad_alloc{}; // for testing purposes
@@ -335,6 +401,17 @@ void* operator new(std::size_t size)
 	throw std::bad_alloc{}; // required by [new.delete.single]/3
 }
 
+// Pairs with the malloc of the operators new above. Default sized and array forms call these.
+TEST_ALLOCATION_FUNCTION void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+TEST_ALLOCATION_FUNCTION void operator delete(void* ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
 
 TEST_CASE("No memory for counter throws", "[]")
 {
@@ -348,15 +425,876 @@ TEST_CASE("No memory for counter throws", "[]")
 }
 
 
+TEST_CASE("make_shared")
+{
+	SECTION("Object and counters share one allocation")
+	{
+		const int before = new_calls;
+		const auto shared = smart_ptr::make_shared<int>(42);
+		REQUIRE(new_calls - before == 1);
+		REQUIRE(*shared == 42);
+		REQUIRE(shared.use_count() == 1);
+	}
+
+	SECTION("Const object")
+	{
+		const int before = new_calls;
+		const auto shared = smart_ptr::make_shared<const int>(5);
+		static_assert(std::is_same_v<decltype(shared.get()), const int*>);
+		REQUIRE(new_calls - before == 1);
+		REQUIRE(*shared == 5);
+		const auto text = smart_ptr::make_shared<const std::string>(3, 'x');
+		REQUIRE(*text == "xxx");
+	}
+
+	SECTION("Arguments are forwarded")
+	{
+		const auto shared = smart_ptr::make_shared<std::pair<int, double>>(1, 2.5);
+		REQUIRE(shared->first == 1);
+		REQUIRE(shared->second == 2.5);
+	}
+
+	SECTION("Object is destroyed while weak_ptr keeps control block")
+	{
+		my_object::set_seed(400);
+		auto shared = smart_ptr::make_shared<my_object>();
+		REQUIRE(shared->id() == 401);
+		smart_ptr::weak_ptr<my_object> weak(shared);
+		REQUIRE(weak.lock().get() == shared.get());
+		shared = smart_ptr::shared_ptr<my_object>{};
+		REQUIRE(my_object::deleted[401] == 1);
+		REQUIRE(weak.expired());
+		REQUIRE(!weak.lock());
+	}
+
+	SECTION("Throwing constructor")
+	{
+		struct throwing
+		{
+			throwing()
+			{
+				throw std::runtime_error("constructor failed");
+			}
+		};
+		REQUIRE_THROWS_AS(smart_ptr::make_shared<throwing>(), std::runtime_error);
+	}
+}
+
+template<typename T>
+struct counting_allocator
+{
+	using value_type = T;
+
+	int* allocations_;
+
+	explicit counting_allocator(int* allocations) noexcept
+		: allocations_(allocations)
+	{
+	}
+
+	template<typename U>
+	counting_allocator(const counting_allocator<U>& other) noexcept
+		: allocations_(other.allocations_)
+	{
+	}
+
+	T* allocate(const std::size_t n)
+	{
+		++*allocations_;
+		return std::allocator<T>{}.allocate(n);
+	}
+
+	void deallocate(T* ptr, const std::size_t n) noexcept
+	{
+		--*allocations_;
+		std::allocator<T>{}.deallocate(ptr, n);
+	}
+
+	template<typename U>
+	friend bool operator==(const counting_allocator& lhs, const counting_allocator<U>& rhs) noexcept
+	{
+		return lhs.allocations_ == rhs.allocations_;
+	}
+};
+
+TEST_CASE("allocate_shared")
+{
+	int allocations = 0;
+	{
+		const auto shared = smart_ptr::allocate_shared<int>(counting_allocator<int>{&allocations}, 7);
+		REQUIRE(allocations == 1);
+		REQUIRE(*shared == 7);
+		{
+			const smart_ptr::weak_ptr<int> weak(shared);
+			const auto copy{shared};  // NOLINT(performance-unnecessary-copy-initialization) // The copy is intentional.
+			REQUIRE(allocations == 1);
+		}
+	}
+	REQUIRE(allocations == 0);
+}
+
+/// Records the size of the control block it allocates. State is kept in measuring_allocator<void>, shared by all rebinds.
+template<typename T>
+struct measuring_allocator
+{
+	using value_type = T;
+
+	static inline std::size_t last_bytes_{0};
+	static inline bool fail_{false};
+
+	measuring_allocator() noexcept = default;
+
+	template<typename U>
+	measuring_allocator(const measuring_allocator<U>&) noexcept
+	{
+	}
+
+	T* allocate(const std::size_t n)
+	{
+		if (measuring_allocator<void>::fail_)
+		{
+			throw std::bad_alloc{};
+		}
+		measuring_allocator<void>::last_bytes_ = n * sizeof(T);
+		return std::allocator<T>{}.allocate(n);
+	}
+
+	void deallocate(T* ptr, const std::size_t n) noexcept
+	{
+		std::allocator<T>{}.deallocate(ptr, n);
+	}
+
+	template<typename U>
+	friend bool operator==(const measuring_allocator&, const measuring_allocator<U>&) noexcept
+	{
+		return true;
+	}
+};
+
+struct counted_delete
+{
+	static inline int calls_{0};
+
+	void operator()(const int* ptr) const noexcept
+	{
+		++calls_;
+		delete ptr;
+	}
+};
+
+/// Returns objects to a free list instead of deleting them.
+struct return_to_pool
+{
+	std::vector<int*>* free_;
+
+	void operator()(int* ptr) const
+	{
+		free_->push_back(ptr);
+	}
+};
+
+TEST_CASE("Custom deleter")
+{
+	using block = smart_ptr::detail::control_block<smart_ptr::atomic_counting>;
+	counted_delete::calls_ = 0;
+
+	SECTION("Stateless deleter takes no space")
+	{
+		{
+			const smart_ptr::shared_ptr<int> shared(new int(1), counted_delete{}, measuring_allocator<int>{});
+			REQUIRE(measuring_allocator<void>::last_bytes_ == sizeof(block));
+			const auto copy = shared;
+			REQUIRE(*copy == 1);
+		}
+		REQUIRE(counted_delete::calls_ == 1);
+	}
+
+	SECTION("Stateful deleter is stored in the control block")
+	{
+		std::vector<int*> free;
+		int pooled = 2;
+		{
+			const smart_ptr::shared_ptr<int> shared(&pooled, return_to_pool{&free}, measuring_allocator<int>{});
+			REQUIRE(measuring_allocator<void>::last_bytes_ == sizeof(block) + sizeof(return_to_pool));
+			const smart_ptr::shared_ptr<int> by_default(&pooled, return_to_pool{&free});
+			REQUIRE(free.empty());
+		}
+		REQUIRE(free.size() == 2);
+		REQUIRE(free.front() == &pooled);
+	}
+
+	SECTION("unique_ptr with deleter")
+	{
+		std::unique_ptr<int, counted_delete> unique(new int(3));
+		const smart_ptr::shared_ptr<int> shared(std::move(unique));
+		REQUIRE(!unique);
+		REQUIRE(*shared == 3);
+		REQUIRE(!smart_ptr::shared_ptr<int>(std::unique_ptr<int, counted_delete>{}));
+	}
+
+	SECTION("Deleter destroys the object when the control block cannot be allocated")
+	{
+		measuring_allocator<void>::fail_ = true;
+		REQUIRE_THROWS_AS(smart_ptr::shared_ptr<int>(new int(4), counted_delete{}, measuring_allocator<int>{}), std::bad_alloc);
+		measuring_allocator<void>::fail_ = false;
+		REQUIRE(counted_delete::calls_ == 1);
+	}
+}
+
+TEST_CASE("local_shared_ptr")
+{
+	my_object::set_seed(500);
+	auto shared = smart_ptr::make_local_shared<my_object>();
+	smart_ptr::local_weak_ptr<my_object> weak(shared);
+	{
+		const auto copy{shared};  // NOLINT(performance-unnecessary-copy-initialization) // The copy is intentional.
+		REQUIRE(shared.use_count() == 2);
+		REQUIRE(weak.lock()->id() == 501);
+	}
+	REQUIRE(shared.use_count() == 1);
+	shared = smart_ptr::local_shared_ptr<my_object>{new my_object};
+	REQUIRE(my_object::deleted[501] == 1);
+	REQUIRE(weak.expired());
+	REQUIRE(!weak.lock());
+	REQUIRE(shared->id() == 502);
+}
+
+TEST_CASE("padded_counting")
+{
+	SECTION("Counters and payload pointer on separate cache lines")
+	{
+		using block = smart_ptr::detail::control_block<smart_ptr::padded_counting>;
+		const block control(nullptr, nullptr);
+		const auto offset = [&control](const void* member)
+		{
+			return static_cast<const char*>(member) - reinterpret_cast<const char*>(&control);
+		};
+		constexpr auto line = static_cast<std::ptrdiff_t>(smart_ptr::detail::cache_line_size);
+		REQUIRE(alignof(block) == line);
+		REQUIRE(offset(&control.usages_) / line != offset(&control.weak_usages_) / line);
+		REQUIRE(offset(&control.payload_) / line > offset(&control.weak_usages_) / line);
+	}
+
+	SECTION("Works like atomic_counting")
+	{
+		auto shared = smart_ptr::make_shared<int, smart_ptr::padded_counting>(9);
+		smart_ptr::weak_ptr<int, smart_ptr::padded_counting> weak(shared);
+		REQUIRE(*weak.lock() == 9);
+		shared = smart_ptr::shared_ptr<int, smart_ptr::padded_counting>{};
+		REQUIRE(weak.expired());
+	}
+}
+
+namespace
+{
+int read_view(const smart_ptr::shared_view<int> view)
+{
+	return *view;
+}
+
+smart_ptr::shared_ptr<int> keep_view(const smart_ptr::shared_view<int> view)
+{
+	return view.share();
+}
+}
+
+TEST_CASE("shared_view")
+{
+	static_assert(sizeof(smart_ptr::basic_shared_view<int, smart_ptr::atomic_counting, false>) == 2 * sizeof(void*));
+	static_assert(std::is_trivially_copyable_v<smart_ptr::basic_shared_view<int, smart_ptr::atomic_counting, false>>);
+
+	SECTION("Borrowing does not count")
+	{
+		const auto shared = smart_ptr::make_shared<int>(11);
+		REQUIRE(read_view(shared) == 11);
+		const smart_ptr::shared_view<int> view = shared;
+		const auto copy = view;
+		REQUIRE(shared.use_count() == 1);
+		REQUIRE(copy.get() == shared.get());
+		REQUIRE(copy == view);
+		REQUIRE(!smart_ptr::shared_view<int>{});
+	}
+
+	SECTION("share() takes one reference")
+	{
+		auto shared = smart_ptr::make_shared<int>(12);
+		const auto kept = keep_view(shared);
+		REQUIRE(shared.use_count() == 2);
+		shared.reset();
+		REQUIRE(*kept == 12);
+		REQUIRE(!keep_view(nullptr));
+	}
+
+	SECTION("Checked view keeps the control block")
+	{
+		using checked = smart_ptr::basic_shared_view<int, smart_ptr::atomic_counting, true>;
+		auto shared = smart_ptr::make_shared<int>(13);
+		checked view = shared;
+		const checked copy = view;
+		REQUIRE(*copy == 13);
+		REQUIRE(copy.share().use_count() == 2);
+		shared.reset();
+		// Block is kept by the views, so the check can see the object is gone.
+		REQUIRE(view.use_count() == 0);
+		view = checked{};
+		REQUIRE(copy.use_count() == 0);
+	}
+}
+
 TEST_CASE("Pointer to subclass")
 {
+	my_object::set_seed(600);
 	auto* orig = new my_object;
 	auto* der = new derived();
 	smart_ptr::shared_ptr<my_object> shared_orig{orig};
 	smart_ptr::shared_ptr<derived> shared_der{der};
-	//shared_orig = shared_der;
+	shared_orig = shared_der;
+	REQUIRE(my_object::deleted[601] == 1);
+	REQUIRE(shared_orig.get() == der);
+	REQUIRE(shared_orig->classId() == 2);
+	REQUIRE(shared_der.use_count() == 2);
+
+	const smart_ptr::shared_ptr<my_object> moved = std::move(shared_der);
+	REQUIRE(!shared_der);
+	REQUIRE(moved.use_count() == 2);
+	smart_ptr::weak_ptr<my_object> weak(moved);
+	shared_orig.reset();
+	REQUIRE(weak.lock()->classId() == 2);
+}
+
+namespace
+{
+/// No virtual destructor: shared_ptr<plain_base>(new plain_derived) must run ~plain_derived.
+struct plain_base
+{
+	int base_value_{1};
+};
+
+struct plain_derived : plain_base, alive_counter<plain_derived>
+{
+};
+
+struct virtually_derived : virtual plain_base, alive_counter<virtually_derived>
+{
+};
+}
+
+TEST_CASE("Pointer to subclass without virtual destructor")
+{
+	{
+		const smart_ptr::shared_ptr<plain_base> base(new plain_derived);
+		const smart_ptr::shared_ptr<const plain_base> constant(new plain_derived);
+		REQUIRE(plain_derived::alive_ == 2);
+		REQUIRE(base->base_value_ == 1);
+	}
+	REQUIRE(plain_derived::alive_ == 0);
+	{
+		// Virtual base lies apart from the object and cannot be cast back.
+		const smart_ptr::shared_ptr<plain_base> base(new virtually_derived);
+		REQUIRE(virtually_derived::alive_ == 1);
+		REQUIRE(base->base_value_ == 1);
+	}
+	REQUIRE(virtually_derived::alive_ == 0);
+}
+
+namespace
+{
+struct pair_of_ints
+{
+	int first_;
+	int second_;
+};
 }
 
+TEST_CASE("Aliasing constructor")
+{
+	auto owner = smart_ptr::make_shared<pair_of_ints>(pair_of_ints{1, 2});
+	const smart_ptr::shared_ptr<int> second(owner, &owner->second_);
+	REQUIRE(*second == 2);
+	REQUIRE(owner.use_count() == 2);
+
+	smart_ptr::weak_ptr<int> weak(second);
+	const smart_ptr::shared_ptr<int> first(std::move(owner), &owner->first_);
+	REQUIRE(!owner);
+	REQUIRE(first.use_count() == 2);
+	REQUIRE(*weak.lock() == 2);
+	REQUIRE(first < second);
+}
+
+TEST_CASE("Pointer casts")
+{
+	my_object::set_seed(700);
+	const smart_ptr::shared_ptr<my_object> base = smart_ptr::make_shared<derived>();
+	REQUIRE(base.use_count() == 1);
+
+	SECTION("static_pointer_cast")
+	{
+		const auto cast = smart_ptr::static_pointer_cast<derived>(base);
+		REQUIRE(cast->classId() == 2);
+		REQUIRE(base.use_count() == 2);
+	}
+
+	SECTION("dynamic_pointer_cast")
+	{
+		REQUIRE(smart_ptr::dynamic_pointer_cast<derived>(base)->classId() == 2);
+		auto copy = base;
+		REQUIRE(base.use_count() == 2);
+		const auto moved = smart_ptr::dynamic_pointer_cast<derived>(std::move(copy));
+		REQUIRE(!copy);
+		REQUIRE(base.use_count() == 2);
+
+		const auto plain = smart_ptr::make_shared<my_object>();
+		auto kept = plain;
+		REQUIRE(!smart_ptr::dynamic_pointer_cast<derived>(std::move(kept)));
+		REQUIRE(kept);
+		REQUIRE(plain.use_count() == 2);
+	}
+
+	SECTION("const_pointer_cast")
+	{
+		const smart_ptr::shared_ptr<const my_object> constant = base;
+		const auto mutable_again = smart_ptr::const_pointer_cast<my_object>(constant);
+		REQUIRE(mutable_again == base);
+		REQUIRE(base.use_count() == 3);
+	}
+
+	SECTION("reinterpret_pointer_cast")
+	{
+		const auto bytes = smart_ptr::reinterpret_pointer_cast<const unsigned char>(base);
+		REQUIRE(static_cast<const void*>(bytes.get()) == static_cast<const void*>(base.get()));
+		REQUIRE(base.use_count() == 2);
+	}
+	REQUIRE(base.use_count() == 1);
+}
+
+
+namespace
+{
+struct alignas(64) wide_element
+{
+	unsigned char bytes_[64];
+};
+
+struct ordered_element
+{
+	static inline std::vector<int> destroyed_{};
+	static inline int next_{0};
+	int index_{next_++};
+
+	~ordered_element()
+	{
+		destroyed_.push_back(index_);
+	}
+};
+
+struct third_throws : alive_counter<third_throws>
+{
+	third_throws()
+	{
+		// Counted by the base already.
+		if (alive_ == 3)
+		{
+			throw std::runtime_error("constructor failed");
+		}
+	}
+};
+}
+
+TEST_CASE("Arrays")
+{
+	SECTION("Array from new[] is freed by delete[]")
+	{
+		my_object::set_seed(800);
+		{
+			const smart_ptr::shared_ptr<my_object[]> shared(new my_object[3]);
+			REQUIRE(shared[0].id() == 801);
+			REQUIRE(shared[2].id() == 803);
+		}
+		REQUIRE(my_object::deleted[801] == 1);
+		REQUIRE(my_object::deleted[803] == 1);
+	}
+
+	SECTION("make_shared<T[]> value-initializes elements in one allocation")
+	{
+		const int before = new_calls;
+		const auto shared = smart_ptr::make_shared<int[]>(1000);
+		REQUIRE(new_calls - before == 1);
+		REQUIRE(std::all_of(shared.get(), shared.get() + 1000, [](const int value) { return value == 0; }));
+		shared[999] = 7;
+		const smart_ptr::shared_ptr<int[]> copy = shared;
+		REQUIRE(copy[999] == 7);
+		REQUIRE(shared.use_count() == 2);
+	}
+
+	SECTION("Elements are aligned")
+	{
+		const auto shared = smart_ptr::make_shared<wide_element[]>(3);
+		REQUIRE(reinterpret_cast<std::uintptr_t>(shared.get()) % alignof(wide_element) == 0);
+	}
+
+	SECTION("Elements are destroyed in reverse order")
+	{
+		ordered_element::destroyed_.clear();
+		ordered_element::next_ = 0;
+		auto shared = smart_ptr::make_shared<ordered_element[]>(3);
+		smart_ptr::weak_ptr<ordered_element[]> weak(shared);
+		shared.reset();
+		REQUIRE(ordered_element::destroyed_ == std::vector<int>{2, 1, 0});
+		REQUIRE(weak.expired());
+	}
+
+	SECTION("Throwing element constructor destroys constructed ones")
+	{
+		REQUIRE_THROWS_AS(smart_ptr::make_shared<third_throws[]>(5), std::runtime_error);
+		REQUIRE(third_throws::alive_ == 0);
+	}
+
+	SECTION("Bounded array")
+	{
+		const auto shared = smart_ptr::make_shared<double[4]>();
+		REQUIRE(shared[3] == 0.0);
+		static_assert(std::is_same_v<decltype(shared.get()), double*>);
+	}
+
+	SECTION("Adopting new T[N]")
+	{
+		ordered_element::destroyed_.clear();
+		ordered_element::next_ = 0;
+		{
+			// Named first: GCC 12 -Wuse-after-free mistakes the inlined new[] for a use after the constructor's delete[].
+			auto* elements = new ordered_element[3];
+			const smart_ptr::shared_ptr<ordered_element[3]> adopted(elements);
+			REQUIRE(adopted[2].index_ == 2);
+			const smart_ptr::shared_ptr<int[2]> numbers(new int[2]{1, 2});
+			REQUIRE(numbers[1] == 2);
+		}
+		REQUIRE(ordered_element::destroyed_ == std::vector<int>{2, 1, 0});
+	}
+
+	SECTION("Empty array")
+	{
+		const auto shared = smart_ptr::make_shared<int[]>(0);
+		REQUIRE(shared.use_count() == 1);
+	}
+
+	SECTION("make_shared_for_overwrite")
+	{
+		const int before = new_calls;
+		const auto buffer = smart_ptr::make_shared_for_overwrite<unsigned char[]>(4096);
+		REQUIRE(new_calls - before == 1);
+		std::fill_n(buffer.get(), 4096, static_cast<unsigned char>(1));
+		REQUIRE(buffer[4095] == 1);
+
+		const auto single = smart_ptr::make_shared_for_overwrite<int>();
+		*single = 5;
+		REQUIRE(*single == 5);
+		const auto bounded = smart_ptr::make_shared_for_overwrite<int[2]>();
+		bounded[1] = 3;
+		REQUIRE(bounded[1] == 3);
+	}
+
+	SECTION("Size overflow")
+	{
+		REQUIRE_THROWS_AS(smart_ptr::make_shared<double[]>(SIZE_MAX / 4), std::bad_array_new_length);
+	}
+}
+
+namespace
+{
+struct session : smart_ptr::enable_shared_from_this<session>
+{
+	int id_{0};
+};
+
+struct secure_session : session
+{
+};
+}
+
+TEST_CASE("enable_shared_from_this")
+{
+	SECTION("make_shared points the self-reference to the block of the object")
+	{
+		const auto owner = smart_ptr::make_shared<session>();
+		const int before = new_calls;
+		const auto self = owner->shared_from_this();
+		auto observer = owner->weak_from_this();
+		REQUIRE(new_calls == before);
+		REQUIRE(self == owner);
+		REQUIRE(owner.use_count() == 2);
+		REQUIRE(observer.lock() == owner);
+	}
+
+	SECTION("Adopting constructors")
+	{
+		const smart_ptr::shared_ptr<session> adopted(new session);
+		REQUIRE(adopted->shared_from_this() == adopted);
+		const smart_ptr::shared_ptr<session> converted(std::make_unique<session>());
+		REQUIRE(converted->shared_from_this().use_count() == 2);
+	}
+
+	SECTION("Derived class and const object")
+	{
+		const smart_ptr::shared_ptr<const secure_session> owner = smart_ptr::make_shared<secure_session>();
+		const smart_ptr::shared_ptr<const session> self = owner->shared_from_this();
+		REQUIRE(self.get() == owner.get());
+		REQUIRE(owner.use_count() == 2);
+	}
+
+	SECTION("Object not owned by a shared_ptr")
+	{
+		session alone;
+		REQUIRE_THROWS_AS(alone.shared_from_this(), std::bad_weak_ptr);
+		REQUIRE(alone.weak_from_this().expired());
+	}
+
+	SECTION("Copy of an object is not owned")
+	{
+		const auto owner = smart_ptr::make_shared<session>();
+		const session copy = *owner;
+		REQUIRE(copy.weak_from_this().expired());
+	}
+
+	SECTION("Self-reference does not keep the object alive")
+	{
+		auto owner = smart_ptr::make_shared<session>();
+		const auto observer = owner->weak_from_this();
+		owner.reset();
+		REQUIRE(observer.expired());
+	}
+}
+
+namespace
+{
+struct counted_node : smart_ptr::ref_counted<>, alive_counter<counted_node>
+{
+	int value_{0};
+
+	explicit counted_node(const int value = 0)
+		: value_(value)
+	{
+	}
+
+	[[nodiscard]] smart_ptr::shared_ptr<counted_node> self()
+	{
+		return smart_ptr::shared_ptr<counted_node>(this);
+	}
+};
+
+struct strong_only_base : smart_ptr::ref_counted<smart_ptr::atomic_counting, false>, alive_counter<strong_only_base>
+{
+	virtual ~strong_only_base() = default;
+};
+
+struct strong_only_derived : strong_only_base
+{
+	std::vector<int> items_ = std::vector<int>(100, 1);
+};
+
+struct local_node : smart_ptr::ref_counted<smart_ptr::local_counting>
+{
+	int value_{3};
+};
+
+/// No virtual destructor: derived parts are destroyed only if the counters know the type adopted.
+struct plain_node : smart_ptr::ref_counted<>
+{
+	int value_{4};
+};
+
+struct plain_node_derived : plain_node, alive_counter<plain_node_derived>
+{
+	std::vector<int> items_ = std::vector<int>(100, 1);
+};
+
+struct other_base
+{
+	long other_{5};
+};
+
+/// Counters not at the start of the object: memory must be freed from the address new returned.
+struct second_base_node : other_base, plain_node, alive_counter<second_base_node>
+{
+};
+
+/// Class allocation functions which the global operator delete must not be paired with.
+struct class_allocated_node : smart_ptr::ref_counted<>
+{
+	static inline int class_new_calls_{0};
+
+	static void* operator new(const std::size_t size)
+	{
+		++class_new_calls_;
+		return ::operator new(size);
+	}
+
+	static void operator delete(void* memory) noexcept
+	{
+		::operator delete(memory);
+	}
+};
+}
+
+TEST_CASE("ref_counted")
+{
+	SECTION("Counters inside the object: one allocation")
+	{
+		{
+			const int before = new_calls;
+			const auto owner = smart_ptr::make_shared<counted_node>(4);
+			const smart_ptr::shared_ptr<counted_node> adopted(new counted_node(5));
+			REQUIRE(new_calls - before == 2);
+			const auto copy = owner;
+			REQUIRE(owner.use_count() == 2);
+			REQUIRE(copy->value_ == 4);
+			REQUIRE(adopted->value_ == 5);
+			REQUIRE(sizeof(owner) == 2 * sizeof(void*));
+		}
+		REQUIRE(counted_node::alive_ == 0);
+	}
+
+	SECTION("this of an owned object is shared again")
+	{
+		{
+			const auto owner = smart_ptr::make_shared<counted_node>();
+			const auto self = owner->self();
+			REQUIRE(self == owner);
+			REQUIRE(self.owner_equal(owner));
+			REQUIRE(owner.use_count() == 2);
+			const smart_ptr::shared_ptr<const counted_node> constant(owner.get());
+			REQUIRE(owner.use_count() == 3);
+		}
+		REQUIRE(counted_node::alive_ == 0);
+	}
+
+	SECTION("weak_ptr outlives the object")
+	{
+		auto owner = smart_ptr::make_shared<counted_node>(1);
+		const smart_ptr::weak_ptr<counted_node> observer(owner);
+		REQUIRE(observer.lock()->value_ == 1);
+		owner.reset();
+		REQUIRE(counted_node::alive_ == 0);
+		REQUIRE(observer.expired());
+		REQUIRE(!observer.lock());
+	}
+
+	SECTION("unique_ptr, copies and objects no shared_ptr owns")
+	{
+		{
+			const smart_ptr::shared_ptr<counted_node> owner(std::make_unique<counted_node>(2));
+			const counted_node copy = *owner;
+			REQUIRE(owner.use_count() == 1);
+			const auto copy_owner = smart_ptr::make_shared<counted_node>(copy);
+			REQUIRE(copy_owner.use_count() == 1);
+			REQUIRE(!copy_owner.owner_equal(owner));
+		}
+		REQUIRE(counted_node::alive_ == 0);
+	}
+
+	SECTION("Without weak support the last shared_ptr deletes through the virtual destructor")
+	{
+		STATIC_REQUIRE(!std::is_constructible_v<smart_ptr::weak_ptr<strong_only_base>, const smart_ptr::shared_ptr<strong_only_base>&>);
+		{
+			const smart_ptr::shared_ptr<strong_only_base> owner(new strong_only_derived);
+			const auto copy = owner;
+			REQUIRE(strong_only_base::alive_ == 1);
+		}
+		REQUIRE(strong_only_base::alive_ == 0);
+	}
+
+	SECTION("Adopted through a base pointer: destroyed and freed as the derived type")
+	{
+		{
+			const smart_ptr::shared_ptr<plain_node> owner(new plain_node_derived);
+			const auto copy = owner;
+			REQUIRE(copy->value_ == 4);
+			REQUIRE(plain_node_derived::alive_ == 1);
+		}
+		REQUIRE(plain_node_derived::alive_ == 0);
+		{
+			auto owner = smart_ptr::shared_ptr<plain_node>(new second_base_node);
+			const smart_ptr::weak_ptr<plain_node> observer(owner);
+			REQUIRE(static_cast<void*>(owner.get()) != static_cast<void*>(static_cast<second_base_node*>(owner.get())));
+			REQUIRE(observer.lock()->value_ == 4);
+			owner.reset();
+			REQUIRE(second_base_node::alive_ == 0);
+			REQUIRE(observer.expired());
+		}
+	}
+
+	SECTION("make_shared allocates by global new, which the last weak release pairs with")
+	{
+		auto owner = smart_ptr::make_shared<class_allocated_node>();
+		const smart_ptr::weak_ptr<class_allocated_node> observer(owner);
+		owner = smart_ptr::make_shared_for_overwrite<class_allocated_node>();
+		REQUIRE(class_allocated_node::class_new_calls_ == 0);
+		REQUIRE(observer.expired());
+	}
+
+	SECTION("Other counting policy")
+	{
+		const auto owner = smart_ptr::make_local_shared<local_node>();
+		const auto copy = owner;
+		REQUIRE(copy.use_count() == 2);
+		REQUIRE(copy->value_ == 3);
+	}
+}
+
+TEST_CASE("Hashing and ownership order")
+{
+	const auto first = smart_ptr::make_shared<pair_of_ints>();
+	const auto second = smart_ptr::make_shared<pair_of_ints>();
+	const smart_ptr::shared_ptr<int> member(first, &first->second_);
+	smart_ptr::weak_ptr<pair_of_ints> weak(first);
+
+	SECTION("std::hash follows get()")
+	{
+		const std::hash<smart_ptr::shared_ptr<pair_of_ints>> hash;
+		REQUIRE(hash(first) == std::hash<pair_of_ints*>{}(first.get()));
+		REQUIRE(hash(smart_ptr::shared_ptr<pair_of_ints>{}) == std::hash<pair_of_ints*>{}(nullptr));
+
+		std::unordered_map<smart_ptr::shared_ptr<pair_of_ints>, int> by_pointer;
+		by_pointer[first] = 1;
+		by_pointer[second] = 2;
+		REQUIRE(by_pointer.at(first) == 1);
+		REQUIRE(by_pointer.at(second) == 2);
+	}
+
+	SECTION("Aliases and weak_ptr share the owner")
+	{
+		REQUIRE(member.owner_equal(first));
+		REQUIRE(weak.owner_equal(member));
+		REQUIRE(member.owner_hash() == first.owner_hash());
+		REQUIRE(weak.owner_hash() == first.owner_hash());
+		REQUIRE(!first.owner_equal(second));
+		REQUIRE(first.owner_before(second) != second.owner_before(first));
+		REQUIRE(!member.owner_before(weak));
+		REQUIRE(!weak.owner_before(member));
+	}
+
+	SECTION("Owner keyed containers")
+	{
+		std::unordered_set<smart_ptr::weak_ptr<pair_of_ints>, smart_ptr::owner_hash, smart_ptr::owner_equal> observed;
+		observed.insert(weak);
+		REQUIRE(observed.contains(member));
+		REQUIRE(!observed.contains(second));
+
+		std::set<smart_ptr::shared_ptr<int>, smart_ptr::owner_less> owners;
+		owners.insert(member);
+		REQUIRE(owners.contains(first));
+		REQUIRE(owners.contains(weak));
+		REQUIRE(!owners.contains(second));
+	}
+
+	SECTION("Expired weak_ptr keeps its key")
+	{
+		auto owner = smart_ptr::make_shared<pair_of_ints>();
+		const smart_ptr::weak_ptr<pair_of_ints> observer(owner);
+		const std::size_t hash = observer.owner_hash();
+		owner.reset();
+		REQUIRE(observer.owner_hash() == hash);
+	}
+}
 
 //------------------------------------------------------------------------
 
@@ -0,0 +1,160 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <utility>
+
+#include "epoch.h"
+
+/// RCU style publisher for read-mostly data (routing tables, configuration): readers see an immutable version,
+/// writers publish a new one.
+///
+///	- read() returns a guard which borrows the current version inside an epoch_guard. Wait-free: announce of the
+///	  epoch (store and fence to a record of this thread) and one plain load. No read-modify-write on the control block
+///	  or on anything shared, no loop and no lock.
+///	- Snapshot owns one strong reference of the current version. publish() and update() retire the reference of the
+///	  replaced version to the epoch domain. It is released through the shared_ptr counts once no guard can borrow it.
+///	- Readers which need a version beyond the guard take share(), one increment.
+///	- publish() replaces the version. update(modify) copies the current version, modifies the copy and publishes it
+///	  by compare-exchange, retrying when another writer came first.
+///	- Guard belongs to the thread which read it, as epoch_guard does. Not movable.
+///
+namespace smart_ptr
+{
+
+template<typename T>
+class snapshot
+{
+	using control_block = typename shared_ptr<T>::control_block;
+
+	/// Owns one strong reference.
+	std::atomic<control_block*> control_{nullptr};
+
+	static void release_(void* control) noexcept
+	{
+		// Adopts the reference of the snapshot and finishes it like any other shared_ptr.
+		shared_ptr<T>{static_cast<control_block*>(control)};
+	}
+
+	static void retire_(control_block* control)
+	{
+		if (control)
+		{
+			detail::epoch_domain::retire(control, &release_);
+		}
+	}
+
+	/// Snapshot keeps the control block only. version must point to its payload (not aliased).
+	static control_block* adopt_(shared_ptr<T>& version) noexcept
+	{
+		version.require_not_aliased_();
+		version.ptr_ = nullptr;
+		return std::exchange(version.control_, nullptr);
+	}
+
+public:
+	/// Read access to one version. Valid as long as the reader lives. Version never changes under it.
+	class reader
+	{
+		friend class snapshot;
+
+		epoch_guard guard_;
+		control_block* control_;
+
+		/// Guard is entered first: a version loaded after it is not released before the guard ends.
+		explicit reader(const std::atomic<control_block*>& src)
+			: control_(src.load(std::memory_order_acquire))
+		{
+		}
+
+	public:
+		reader(const reader&) = delete;
+		reader& operator=(const reader&) = delete;
+
+		[[nodiscard]] explicit operator bool() const noexcept
+		{
+			return control_ != nullptr;
+		}
+
+		[[nodiscard]] const T* get() const noexcept
+		{
+			return control_ ? static_cast<const T*>(control_->payload_) : nullptr;
+		}
+
+		[[nodiscard]] const T& operator*() const noexcept
+		{
+			return *get();
+		}
+
+		[[nodiscard]] const T* operator->() const noexcept
+		{
+			return get();
+		}
+
+		/// Keeps the version after the reader ends. One increment. Strong count is not zero: retired reference
+		/// of the snapshot is not released while the guard lives.
+		[[nodiscard]] shared_ptr<const T> share() const noexcept
+		{
+			if (control_)
+			{
+				++control_->usages_;
+			}
+			return shared_ptr<T>{control_};
+		}
+	};
+
+	constexpr snapshot() noexcept = default;
+
+	explicit snapshot(shared_ptr<T> first) noexcept
+		: control_(adopt_(first))
+	{
+	}
+
+	snapshot(const snapshot&) = delete;
+	snapshot& operator=(const snapshot&) = delete;
+
+	~snapshot()
+	{
+		retire_(control_.load(std::memory_order_relaxed));
+	}
+
+	/// version must come from make_shared or shared_ptr(T*), not aliased. Nobody may modify it after publishing.
+	void publish(shared_ptr<T> version)
+	{
+		retire_(control_.exchange(adopt_(version), std::memory_order_seq_cst));
+	}
+
+	[[nodiscard]] reader read() const
+	{
+		return reader{control_};
+	}
+
+	[[nodiscard]] shared_ptr<const T> load() const
+	{
+		return read().share();
+	}
+
+	/// modify(T&) changes a copy of the current version. Called again on a fresh copy when another writer published first.
+	/// Snapshot must not be empty.
+	template<typename Modify>
+	void update(Modify&& modify)
+	{
+		for (;;)
+		{
+			// No ABA: current cannot be released and its block reused while the guard of the reader lives.
+			const reader current = read();
+			assert(current && "update() of an empty snapshot");
+			auto next = make_shared<T>(*current);
+			modify(*next);
+			control_block* expected = current.control_;
+			control_block* desired = next.control_;
+			if (control_.compare_exchange_strong(expected, desired, std::memory_order_seq_cst, std::memory_order_relaxed))
+			{
+				adopt_(next);
+				retire_(expected);
+				return;
+			}
+		}
+	}
+};
+
+}
@@ -0,0 +1,166 @@
+#include "catch.hpp"
+#include "alive_counter.h"
+#include "snapshot.h"
+
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+struct routes : alive_counter<routes>
+{
+	std::map<std::string, int> next_hop_;
+	int version_{0};
+};
+}
+
+TEST_CASE("snapshot")
+{
+	SECTION("Reader keeps its version while a new one is published")
+	{
+		{
+			auto first = smart_ptr::make_shared<routes>();
+			first->next_hop_["a"] = 1;
+			smart_ptr::snapshot<routes> table(std::move(first));
+			const auto before = table.read();
+			const smart_ptr::shared_ptr<routes> second = smart_ptr::make_shared<routes>();
+			second->version_ = 1;
+			table.publish(second);
+			REQUIRE(before->next_hop_.at("a") == 1);
+			REQUIRE(table.read()->version_ == 1);
+			REQUIRE(before->version_ == 0);
+		}
+		smart_ptr::epoch_clean_up();
+		REQUIRE(routes::alive_ == 0);
+	}
+
+	SECTION("update copies, modifies and publishes")
+	{
+		{
+			smart_ptr::snapshot<routes> table(smart_ptr::make_shared<routes>());
+			const auto kept = table.load();
+			table.update([](routes& next)
+			{
+				next.next_hop_["b"] = 2;
+				++next.version_;
+			});
+			REQUIRE(table.read()->next_hop_.at("b") == 2);
+			REQUIRE(kept->next_hop_.empty());
+			REQUIRE(kept->version_ == 0);
+		}
+		smart_ptr::epoch_clean_up();
+		REQUIRE(routes::alive_ == 0);
+	}
+
+	SECTION("read() borrows, share() takes one reference")
+	{
+		{
+			const auto first = smart_ptr::make_shared<routes>();
+			const smart_ptr::snapshot<routes> table(first);
+			REQUIRE(first.use_count() == 2);
+			{
+				const auto current = table.read();
+				REQUIRE(current.get() == first.get());
+				REQUIRE(first.use_count() == 2);
+				const auto shared = current.share();
+				REQUIRE(first.use_count() == 3);
+			}
+			REQUIRE(first.use_count() == 2);
+		}
+		smart_ptr::epoch_clean_up();
+		REQUIRE(routes::alive_ == 0);
+	}
+
+	SECTION("Empty snapshot")
+	{
+		const smart_ptr::snapshot<routes> table;
+		REQUIRE(!table.read());
+		REQUIRE(!table.load());
+	}
+}
+
+TEST_CASE("snapshot read by many threads")
+{
+	constexpr int readers = 4;
+	constexpr int reads = 500'000;
+	{
+		auto first = smart_ptr::make_shared<routes>();
+		first->version_ = 7;
+		const smart_ptr::snapshot<routes> table(std::move(first));
+		std::atomic<bool> wrong_read{false};
+		std::vector<std::thread> threads;
+		for (int i = 0; i < readers; ++i)
+		{
+			threads.emplace_back([&table, &wrong_read]
+			{
+				for (int j = 0; j < reads; ++j)
+				{
+					// Published version is never released under the readers.
+					if (table.read()->version_ != 7 || routes::alive_ != 1)
+					{
+						wrong_read = true;
+					}
+				}
+			});
+		}
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+		REQUIRE(!wrong_read);
+		REQUIRE(routes::alive_ == 1);
+	}
+	smart_ptr::epoch_clean_up();
+	REQUIRE(routes::alive_ == 0);
+}
+
+TEST_CASE("snapshot updated by many threads")
+{
+	constexpr int writers = 4;
+	constexpr int readers = 4;
+	constexpr int updates = 2'000;
+	{
+		smart_ptr::snapshot<routes> table(smart_ptr::make_shared<routes>());
+		std::atomic<bool> wrong_read{false};
+		std::atomic<int> writers_done{0};
+		std::vector<std::thread> threads;
+		for (int i = 0; i < writers; ++i)
+		{
+			threads.emplace_back([&table, &writers_done]
+			{
+				for (int j = 0; j < updates; ++j)
+				{
+					table.update([](routes& next) { ++next.version_; });
+				}
+				++writers_done;
+			});
+		}
+		for (int i = 0; i < readers; ++i)
+		{
+			threads.emplace_back([&table, &wrong_read, &writers_done]
+			{
+				int last = 0;
+				while (writers_done != writers)
+				{
+					// Versions only grow: no update is lost and no reader sees an older one after a newer.
+					const auto current = table.read();
+					if (current->version_ < last)
+					{
+						wrong_read = true;
+					}
+					last = current->version_;
+				}
+			});
+		}
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+		REQUIRE(!wrong_read);
+		REQUIRE(table.read()->version_ == writers * updates);
+	}
+	smart_ptr::epoch_clean_up();
+	REQUIRE(routes::alive_ == 0);
+}